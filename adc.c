@@ -2,6 +2,7 @@
 
 #include <msp430.h>
 
+#include "global_const.h"
 #include "simple_io.h"
 
 static uint8_t ADC_PINS[] = { 3, 5 };
@@ -44,6 +45,18 @@ void adc_init(adc_t* _adc)
     adc = _adc;
     adc_input_index = 0;
 
+#ifdef ADC_SYNC_TO_FRAME
+    /* Configure ADC10 with:
+     * Vcc/Vss reference
+     * 64x ADC10CLK cycles per conversion
+     * 50ksps reference buffer
+     * single conversion, first one triggered by TA0.1
+     * turn on the ADC10
+     */
+    ADC10CTL0 = SREF_0 | ADC10SHT_3 | ADC10SR | ADC10IE | ADC10ON;
+
+    ADC10CTL1 = INCH_0 | SHS_1 | ADC10DIV_7 | ADC10SSEL_3 | CONSEQ_0;
+#else
     /* Configure ADC10 with:
      * Vcc/Vss reference
      * 64x ADC10CLK cycles per conversion
@@ -54,6 +67,7 @@ void adc_init(adc_t* _adc)
     ADC10CTL0 = SREF_0 | ADC10SHT_3 | ADC10SR | ADC10IE | MSC | ADC10ON;
 
     ADC10CTL1 = INCH_0 | SHS_0 | ADC10DIV_7 | ADC10SSEL_3 | CONSEQ_2;
+#endif
 
     for(uint8_t i = 0; i < NUM_ADC_CHANNELS; i++)
     {
@@ -63,18 +77,48 @@ void adc_init(adc_t* _adc)
 
     select_analog_channel(ADC_PINS[adc_input_index]);
 
+#ifdef ADC_SYNC_TO_FRAME
+    ADC10CTL0 |= ENC;
+#else
     ADC10CTL0 |= ADC10SC | ENC;
+#endif
 }
 
 __attribute__((__interrupt__(ADC10_VECTOR)))
 void ISR_adc10()
 {
+    uint16_t val = ADC10MEM;
+
     ADC10CTL0 &= ~ADC10IFG;
 
-    adc->val[adc_input_index++] = ADC10MEM;
+    adc->val[adc_input_index] = val;
+#ifdef ATTENTION_LINE
+    adc_indicate_sample(adc_input_index, val);
+#endif
+    adc_input_index++;
+
+#ifdef ADC_SYNC_TO_FRAME
+    // INCH and SHS can only be changed while ENC is clear
+    ADC10CTL0 &= ~ENC;
+#endif
 
     if(adc_input_index == NUM_ADC_CHANNELS)
         adc_input_index = 0;
 
     select_analog_channel(ADC_PINS[adc_input_index]);
+
+#ifdef ADC_SYNC_TO_FRAME
+    if(adc_input_index == 0)
+    {
+        // Scan complete; arm for the trigger in the next frame
+        ADC10CTL1 = (ADC10CTL1 & ~SHS_3) | SHS_1;
+        ADC10CTL0 |= ENC;
+    }
+    else
+    {
+        // Chain the rest of the scan directly off the triggered conversion
+        ADC10CTL1 &= ~SHS_3;
+        ADC10CTL0 |= ENC | ADC10SC;
+    }
+#endif
 }
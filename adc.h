@@ -5,6 +5,20 @@
 
 #define NUM_ADC_CHANNELS (2)
 
+/*
+ * Uncomment this to have Timer_A trigger the conversions instead of letting
+ * the ADC free-run. Once per servo frame, TA0.1 starts a single scan of all
+ * channels ADC_SYNC_PHASE_US after the falling edge of the last servo pulse,
+ * so samples are taken in the quiet part of the frame and have a known age.
+ */
+//#define ADC_SYNC_TO_FRAME
+
+/*
+ * Delay from the last falling edge of the frame to the start of the scan.
+ * Must be shorter than the time left in the slot after the longest pulse.
+ */
+#define ADC_SYNC_PHASE_US (100ul)
+
 typedef struct
 {
     uint16_t val[2];
@@ -12,4 +26,7 @@ typedef struct
 
 void adc_init(adc_t* _adc);
 
+/* Called from the ADC interrupt with each new reading (attention.c) */
+void adc_indicate_sample(uint8_t channel, uint16_t val);
+
 #endif // ADC_H
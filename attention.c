@@ -0,0 +1,147 @@
+/*
+ * attention.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "attention.h"
+
+#ifdef ATTENTION_LINE
+
+#include <msp430.h>
+
+#include <stddef.h>
+
+#include "adc.h"
+#include "keyframe.h"
+#include "simple_io.h"
+#include "simple_math.h"
+
+static attention_t* attn;
+
+/* ADC readings that last raised ATTN_ADC */
+static uint16_t adc_reported[NUM_ADC_CHANNELS];
+/* Bit n set while channel n reads above adc_threshold */
+static uint8_t adc_above;
+
+/**
+ * @brief Drives the line from the pending and enabled events.
+ */
+static void attention_update()
+{
+    if(attn->status & attn->enable)
+    {
+        assert_pin_open_drain(ATTN_PIN);
+    }
+    else
+    {
+        release_pin_open_drain(ATTN_PIN);
+    }
+}
+
+/**
+ * @brief Initializes the attention registers and releases the line.
+ *
+ * @param regs The registers, mapped into the register map by the caller.
+ */
+void attention_init(attention_t* regs)
+{
+    attn = regs;
+
+    attn->enable = 0;
+    attn->ack = 0;
+    attn->adc_delta = 0;
+    attn->adc_threshold = 0;
+    attn->status = 0;
+
+    for(uint8_t i = 0; i < NUM_ADC_CHANNELS; i++)
+        adc_reported[i] = 0;
+    adc_above = 0;
+
+    attention_update();
+}
+
+/**
+ * @brief Flags events, asserting the line if any of them is enabled.
+ *
+ * Must be called with interrupts disabled (from an interrupt handler, or
+ * between _BIC_SR(GIE) and _BIS_SR(GIE)), since the master's acknowledge
+ * arrives from the I2C interrupt.
+ *
+ * @param events Bitmask of ATTN_ events.
+ */
+void attention_raise(uint8_t events)
+{
+    attn->status |= events;
+    attention_update();
+}
+
+/**
+ * @brief Region hook for the writable part of attention_t; applies
+ * acknowledges and enable changes.
+ *
+ * @param offset Offset of the byte written into attention_t.
+ */
+void attention_on_write(uint16_t offset)
+{
+    if(offset == offsetof(attention_t, ack))
+    {
+        attn->status &= ~attn->ack;
+        attn->ack = 0;
+    }
+
+    attention_update();
+}
+
+void adc_indicate_sample(uint8_t channel, uint16_t val)
+{
+    uint8_t bit = 1 << channel;
+    uint8_t above = (val > attn->adc_threshold) ? bit : 0;
+
+    if(distance(val, adc_reported[channel]) > attn->adc_delta)
+    {
+        adc_reported[channel] = val;
+        attention_raise(ATTN_ADC);
+    }
+
+    if((adc_above & bit) != above)
+    {
+        adc_above ^= bit;
+        attention_raise(ATTN_ADC_LEVEL);
+    }
+}
+
+void servo_indicate_frame()
+{
+    attention_raise(ATTN_FRAME);
+}
+
+#ifdef SERVO_KEYFRAMES
+/* Called from the main loop, unlike the other hooks */
+void keyframe_indicate_free(uint8_t servo)
+{
+    _BIC_SR(GIE);
+    attention_raise(ATTN_QUEUE);
+    _BIS_SR(GIE);
+}
+#endif
+
+#endif // ATTENTION_LINE
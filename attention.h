@@ -0,0 +1,71 @@
+/*
+ * attention.h
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Attention line: an open-drain output the firmware pulls low while an event
+ * the master asked for is pending, so the master can wait on an edge
+ * interrupt instead of polling the bus.
+ */
+
+#ifndef ATTENTION_H
+#define ATTENTION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "global_const.h"
+
+/* P1.4, free on both supported parts */
+#define ATTN_PIN (4)
+
+/* Events */
+#define ATTN_COMMIT (0x01)  // A commit was applied
+#define ATTN_ADC (0x02)     // A pot moved by more than adc_delta
+#define ATTN_FRAME (0x04)   // A servo frame started
+#define ATTN_QUEUE (0x08)   // A keyframe queue entry was freed
+#define ATTN_ADC_LEVEL (0x10) // A pot crossed adc_threshold, either way
+
+typedef struct
+{
+    /* Events that assert the line */
+    uint8_t enable;
+    /* Write 1s here to clear the matching status bits; reads as 0 */
+    uint8_t ack;
+    /*
+     * Change of an ADC reading, since the last one that raised ATTN_ADC, that
+     * raises it again
+     */
+    uint16_t adc_delta;
+    /* Reading a pot crosses, either way, to raise ATTN_ADC_LEVEL */
+    uint16_t adc_threshold;
+    /* Events raised since the master last acknowledged them (read-only) */
+    uint8_t status;
+    uint8_t pad;
+} attention_t;
+
+/* The part of attention_t the master may write */
+#define ATTENTION_WRITABLE_LEN (offsetof(attention_t, status))
+
+void attention_init(attention_t* regs);
+void attention_raise(uint8_t events);
+void attention_on_write(uint16_t offset);
+
+#endif // ATTENTION_H
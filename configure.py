@@ -5,6 +5,20 @@ import os, sys
 
 MCU = "msp430g2231"
 
+# RAM of each supported part, in bytes
+RAM_SIZE = {
+        "msp430g2231": 128,
+        # The G2x53 parts have no USI, so only host builds of these work yet
+        "msp430g2153": 256,
+        "msp430g2253": 256,
+        "msp430g2353": 256,
+        "msp430g2453": 512,
+        "msp430g2553": 512,
+}[MCU]
+
+# Bytes of RAM the budget check keeps free
+RAM_MARGIN = 8
+
 source_dirs = [
         ".",
 #        "util"
@@ -40,13 +54,13 @@ def get_includes():
 def get_defines():
     return " ".join(map(lambda x : "-D"+x, defines))
 
-cflags = ("-g -c -O3 -ffunction-sections -fdata-sections " +
+cflags = ("-g -c -O3 -ffunction-sections -fdata-sections -fstack-usage " +
           "-fsingle-precision-constant -std=c99 -DF_CPU=16000000L " +
           "-mmcu=" + MCU + " " +
           get_defines() + " " + get_includes())
 
 cxxflags = ("-g -c -O3 -std=c++0x -fno-rtti -fno-exceptions " +
-            "-ffunction-sections -fdata-sections " +
+            "-ffunction-sections -fdata-sections -fstack-usage " +
             "-fsingle-precision-constant " +
             "-DF_CPU=16000000L -mmcu=" + MCU + " " +
             get_defines() + " " + get_includes())
@@ -87,6 +101,10 @@ def write_buildfile():
         n.rule("oc",
                command = "msp430-objcopy -O binary $in $out")
 
+        n.rule("ram",
+               command = "python ram_budget.py --ram " + str(RAM_SIZE) +
+                         " --margin " + str(RAM_MARGIN) + " -o $out $in")
+
         n.rule("cdb",
               command = "ninja -t compdb cc cxx > compile_commands.json")
 
@@ -125,6 +143,12 @@ def write_buildfile():
 
         n.build("main.bin", "oc", "main.elf")
 
+        # Fails, and so fails the default build, if static RAM plus
+        # worst-case stack does not fit
+        n.build("ram_budget.txt", "ram", ["main.elf"] + objects)
+
+        n.default(["main.elf", "main.bin", "ram_budget.txt"])
+
 if __name__ == "__main__":
     write_buildfile()
 
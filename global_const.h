@@ -27,4 +27,11 @@
 
 #define CLOCK_SPEED_MHz 16
 
+/*
+ * Uncomment this to enable the attention line and its registers (attention.h).
+ * It is here rather than in attention.h because the servo, ADC and keyframe
+ * code call into it too. The line needs a pull-up on the master's side.
+ */
+//#define ATTENTION_LINE
+
 #endif /* GLOBAL_CONST_H */
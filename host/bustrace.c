@@ -0,0 +1,298 @@
+/*
+ * bustrace.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Parsing and writing of the bus trace format, and a bus backend that records
+ * everything passing through another backend.
+ */
+
+#include "bustrace.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int hex_digit(char c)
+{
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    c = tolower((unsigned char)c);
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+static int hex_byte(const char* s)
+{
+    int hi = hex_digit(s[0]);
+    int lo = (hi < 0) ? -1 : hex_digit(s[1]);
+
+    return (lo < 0) ? -1 : (hi << 4) | lo;
+}
+
+/**
+ * @brief Parses one message token, e.g. "W40:0005!" or "R40:01??".
+ */
+static int parse_msg(const char* tok, bustrace_msg_t* msg)
+{
+    int addr;
+
+    if((tok[0] != 'W' && tok[0] != 'R') || (addr = hex_byte(tok + 1)) < 0 ||
+       addr > 0x7F)
+        return -EINVAL;
+
+    msg->read = (tok[0] == 'R');
+    msg->addr = addr;
+    msg->len = 0;
+    tok += 3;
+
+    msg->addr_nack = (*tok == '!');
+    if(msg->addr_nack)
+        tok++;
+
+    if(*tok == 0)
+        return 0;
+    if(*tok++ != ':')
+        return -EINVAL;
+
+    while(*tok)
+    {
+        int byte;
+
+        if(msg->len == BUSTRACE_MAX_BYTES)
+            return -E2BIG;
+
+        if(tok[0] == '?' && tok[1] == '?')
+        {
+            msg->known[msg->len] = false;
+            msg->buf[msg->len] = 0;
+        }
+        else if((byte = hex_byte(tok)) >= 0)
+        {
+            msg->known[msg->len] = true;
+            msg->buf[msg->len] = byte;
+        }
+        else
+        {
+            return -EINVAL;
+        }
+        tok += 2;
+
+        msg->nack[msg->len] = (*tok == '!');
+        if(*tok == '!')
+            tok++;
+
+        msg->len++;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Parses a line of a trace, tokenizing it in place.
+ */
+static int parse_line(char* buf, bustrace_xact_t* xact)
+{
+    char *tok, *save, *end;
+    int ret;
+
+    if((end = strchr(buf, '#')))
+        *end = 0;
+
+    if(!(tok = strtok_r(buf, " \t\r\n", &save)))
+        return 0;
+
+    xact->t_us = strtoull(tok, &end, 10);
+    if(*end)
+        return -EINVAL;
+
+    xact->stop = true;
+    xact->count = 0;
+
+    while((tok = strtok_r(0, " \t\r\n", &save)))
+    {
+        if(!strcmp(tok, "nostop"))
+        {
+            xact->stop = false;
+            continue;
+        }
+
+        if(xact->count == SERVOCTL_MAX_MSGS)
+            return -E2BIG;
+        if((ret = parse_msg(tok, &xact->msgs[xact->count])))
+            return ret;
+        xact->count++;
+    }
+
+    return xact->count ? 1 : -EINVAL;
+}
+
+/**
+ * @brief Parses a line of a trace, of any length.
+ *
+ * @return 1 if the line held a transaction, 0 if it was blank or a comment,
+ * or a negative errno value if it is malformed (-E2BIG for a message longer
+ * than BUSTRACE_MAX_BYTES) or could not be copied.
+ */
+int bustrace_parse(const char* line, bustrace_xact_t* xact)
+{
+    char* buf = strdup(line);
+    int ret;
+
+    if(!buf)
+        return -ENOMEM;
+
+    ret = parse_line(buf, xact);
+    free(buf);
+    return ret;
+}
+
+void bustrace_write(FILE* f, const bustrace_xact_t* xact)
+{
+    fprintf(f, "%llu", (unsigned long long)xact->t_us);
+
+    for(unsigned i = 0; i < xact->count; i++)
+    {
+        const bustrace_msg_t* msg = &xact->msgs[i];
+
+        fprintf(f, " %c%02X%s", msg->read ? 'R' : 'W', msg->addr,
+                msg->addr_nack ? "!" : "");
+        if(msg->len)
+            fputc(':', f);
+
+        for(uint16_t j = 0; j < msg->len; j++)
+        {
+            if(msg->known[j])
+                fprintf(f, "%02x", msg->buf[j]);
+            else
+                fputs("??", f);
+            if(msg->nack[j])
+                fputc('!', f);
+        }
+    }
+
+    fputs(xact->stop ? "\n" : " nostop\n", f);
+}
+
+/**
+ * @brief Fills in a transaction from host library messages, after they have
+ * been transferred (so read buffers hold the data).
+ */
+void bustrace_from_msgs(bustrace_xact_t* xact, uint64_t t_us,
+                        const servoctl_msg_t* msgs, unsigned count)
+{
+    xact->t_us = t_us;
+    xact->stop = true;
+    xact->count = (count < SERVOCTL_MAX_MSGS) ? count : SERVOCTL_MAX_MSGS;
+
+    for(unsigned i = 0; i < xact->count; i++)
+    {
+        bustrace_msg_t* msg = &xact->msgs[i];
+
+        msg->addr = msgs[i].addr;
+        msg->read = msgs[i].flags & SERVOCTL_MSG_READ;
+        msg->addr_nack = false;
+        msg->len = (msgs[i].len < BUSTRACE_MAX_BYTES) ? msgs[i].len
+                                                       : BUSTRACE_MAX_BYTES;
+        memcpy(msg->buf, msgs[i].buf, msg->len);
+        memset(msg->known, true, msg->len);
+        memset(msg->nack, false, msg->len);
+    }
+}
+
+typedef struct
+{
+    servoctl_bus_t inner;
+    FILE* out;
+    struct timespec start;
+    bool started;
+    bustrace_xact_t xact;
+} record_ctx_t;
+
+static int record_xfer(void* ctx, servoctl_msg_t* msgs, unsigned count)
+{
+    record_ctx_t* rec = ctx;
+    struct timespec now;
+    uint64_t t_us;
+    int ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(!rec->started)
+    {
+        rec->start = now;
+        rec->started = true;
+    }
+    t_us = (now.tv_sec - rec->start.tv_sec) * 1000000ull +
+           (now.tv_nsec - rec->start.tv_nsec) / 1000;
+
+    ret = rec->inner.xfer(rec->inner.ctx, msgs, count);
+
+    /*
+     * The bus layer doesn't say where a failed transfer stopped, so the read
+     * data of a failed transaction is recorded as unknown.
+     */
+    bustrace_from_msgs(&rec->xact, t_us, msgs, count);
+    if(ret)
+    {
+        for(unsigned i = 0; i < rec->xact.count; i++)
+            if(rec->xact.msgs[i].read)
+                memset(rec->xact.msgs[i].known, false, rec->xact.msgs[i].len);
+        fprintf(rec->out, "# error %d\n", ret);
+    }
+    bustrace_write(rec->out, &rec->xact);
+
+    return ret;
+}
+
+static void record_close(void* ctx)
+{
+    record_ctx_t* rec = ctx;
+
+    if(rec->inner.close)
+        rec->inner.close(rec->inner.ctx);
+    fflush(rec->out);
+    free(rec);
+}
+
+/**
+ * @brief Wraps a bus so that every transaction is also written to a trace.
+ * Closing the bus closes the inner bus too, but not the trace file.
+ *
+ * @return 0, or -ENOMEM.
+ */
+int servoctl_bus_record(servoctl_bus_t* bus, servoctl_bus_t inner, FILE* out)
+{
+    record_ctx_t* rec = calloc(1, sizeof(*rec));
+
+    if(!rec)
+        return -ENOMEM;
+
+    rec->inner = inner;
+    rec->out = out;
+
+    bus->xfer = record_xfer;
+    bus->close = record_close;
+    bus->ctx = rec;
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/*
+ * bustrace.h
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Text format for captured I2C bus traffic. Each line is one transaction (start
+ * to stop) with a timestamp in microseconds, followed by its messages, which
+ * are separated on the bus by repeated starts:
+ *
+ *   1000 W40:05e803            write 0x05 0xe8 0x03 to 0x40
+ *   2000 W40:00 R40:0102??     write 0x00, then read three bytes, the last
+ *                              one unknown
+ *   3000 W40:0203! nostop      the device NACKed 0x03, and no stop followed
+ *
+ * A '!' after the address or a byte means the device NACKed it. "nostop" means
+ * the next transaction's start is really a repeated start. Everything after a
+ * '#' is a comment.
+ */
+
+#ifndef BUSTRACE_H
+#define BUSTRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "servoctl.h"
+
+#define BUSTRACE_MAX_BYTES (512)
+
+typedef struct
+{
+    uint8_t addr;
+    bool read;
+    bool addr_nack;
+    uint16_t len;
+    uint8_t buf[BUSTRACE_MAX_BYTES];
+    /* Whether each byte's value is known, and whether it was NACKed */
+    bool known[BUSTRACE_MAX_BYTES];
+    bool nack[BUSTRACE_MAX_BYTES];
+} bustrace_msg_t;
+
+typedef struct
+{
+    uint64_t t_us;
+    bool stop;
+    unsigned count;
+    bustrace_msg_t msgs[SERVOCTL_MAX_MSGS];
+} bustrace_xact_t;
+
+int bustrace_parse(const char* line, bustrace_xact_t* xact);
+void bustrace_write(FILE* f, const bustrace_xact_t* xact);
+void bustrace_from_msgs(bustrace_xact_t* xact, uint64_t t_us,
+                        const servoctl_msg_t* msgs, unsigned count);
+
+int servoctl_bus_record(servoctl_bus_t* bus, servoctl_bus_t inner, FILE* out);
+
+#endif // BUSTRACE_H
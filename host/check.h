@@ -0,0 +1,47 @@
+/*
+ * check.h
+ *
+ * Copyright (C) 2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *
+ * Assertion helper for the host tests: a failed check prints its location
+ * and the formatted values, and counts towards check_failures, so a test
+ * runs all of its checks before exiting with a status.
+ */
+
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+#include <stdio.h>
+
+static int check_failures;
+
+#define CHECK(expr, fmt, ...) \
+    do \
+    { \
+        if(!(expr)) \
+        { \
+            fprintf(stderr, "FAIL %s:%d: " fmt "\n", __FILE__, __LINE__, \
+                    __VA_ARGS__); \
+            check_failures++; \
+        } \
+    } while(0)
+
+#endif // HOST_CHECK_H
@@ -0,0 +1,181 @@
+/*
+ * fakedev.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * The USI model works a byte (or an acknowledge bit) at a time: the master
+ * side puts data into USISRL, or takes it out, whenever the driver has armed
+ * the bit counter, then raises USIIFG and calls the driver's interrupt
+ * handler. A start condition raises USISTTIFG and a stop sets USISTP, which the
+ * driver only notices lazily, as on the real part.
+ */
+
+#include "fakedev.h"
+
+#include <errno.h>
+
+#include <msp430.h>
+
+#include "firmware.h"
+#include "servoctl.h"
+
+#define USICNT_BITS (0x1F)
+
+/* Main loop iterations to run after each transaction */
+#define FAKEDEV_SERVICE_ITERATIONS (4)
+
+static bool fakedev_ready;
+
+/**
+ * @brief Clocks the bits the driver has armed the counter for.
+ *
+ * @return Whether the driver was listening.
+ */
+static bool fakedev_clock()
+{
+    if(!(USICNT & USICNT_BITS))
+        return false;
+
+    USICNT &= ~USICNT_BITS;
+    USICTL1 |= USIIFG;
+    firmware_usi_int();
+
+    return true;
+}
+
+/**
+ * @brief Boots the firmware. Safe to call more than once.
+ */
+void fakedev_init(void)
+{
+    if(fakedev_ready)
+        return;
+
+    firmware_init();
+    fakedev_ready = true;
+}
+
+void fakedev_start(void)
+{
+    USICTL1 |= USISTTIFG;
+    firmware_usi_int();
+}
+
+void fakedev_stop(void)
+{
+    USICTL1 |= USISTP;
+
+    for(int i = 0; i < FAKEDEV_SERVICE_ITERATIONS; i++)
+        firmware_service();
+}
+
+/**
+ * @brief Sends a byte from the master.
+ *
+ * @return Whether the device acknowledged it.
+ */
+bool fakedev_write(uint8_t byte)
+{
+    bool ack;
+
+    USISRL = byte;
+    if(!fakedev_clock())
+        return false;
+
+    // The driver drives the acknowledge bit out of the MSB
+    ack = (USICTL0 & USIOE) && !(USISRL & 0x80);
+    fakedev_clock();
+
+    return ack;
+}
+
+/**
+ * @brief Receives a byte from the device.
+ *
+ * @param ack Whether the master acknowledges the byte (asks for more).
+ *
+ * @return The byte; 0xFF if the device was not driving the bus.
+ */
+uint8_t fakedev_read(bool ack)
+{
+    uint8_t byte = (USICTL0 & USIOE) ? USISRL : 0xFF;
+
+    if(!fakedev_clock())
+        return 0xFF;
+
+    // The acknowledge bit is shifted into the LSB
+    USISRL = (USISRL << 1) | (ack ? 0 : 1);
+    fakedev_clock();
+
+    return byte;
+}
+
+static int fakedev_xfer(void* ctx, servoctl_msg_t* msgs, unsigned count)
+{
+    int ret = 0;
+
+    (void)ctx;
+
+    for(unsigned i = 0; i < count && !ret; i++)
+    {
+        bool read = msgs[i].flags & SERVOCTL_MSG_READ;
+
+        fakedev_start();
+
+        if(!fakedev_write((msgs[i].addr << 1) | (read ? 1 : 0)))
+        {
+            ret = -ENXIO;
+            break;
+        }
+
+        for(uint16_t j = 0; j < msgs[i].len; j++)
+        {
+            if(read)
+            {
+                msgs[i].buf[j] = fakedev_read(j + 1 < msgs[i].len);
+            }
+            else if(!fakedev_write(msgs[i].buf[j]))
+            {
+                ret = -EIO;
+                break;
+            }
+        }
+    }
+
+    fakedev_stop();
+
+    return ret;
+}
+
+/**
+ * @brief Sets up a bus with the in-process fake device on it.
+ *
+ * @return 0.
+ */
+int servoctl_bus_fake(servoctl_bus_t* bus)
+{
+    fakedev_init();
+
+    bus->xfer = fakedev_xfer;
+    bus->close = 0;
+    bus->ctx = 0;
+
+    return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * fakedev.h
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * In-process stand-in for the device: the firmware's own I2C driver and main
+ * loop, built for the host, behind a byte-level model of the USI shift
+ * register. There is a single firmware instance per process.
+ */
+
+#ifndef FAKEDEV_H
+#define FAKEDEV_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void fakedev_init(void);
+
+void fakedev_start(void);
+void fakedev_stop(void);
+bool fakedev_write(uint8_t byte);
+uint8_t fakedev_read(bool ack);
+
+#endif // FAKEDEV_H
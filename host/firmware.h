@@ -0,0 +1,57 @@
+/*
+ * firmware.h
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Entry points into the firmware sources built for the host. The firmware
+ * keeps its state in file-scope statics and its interrupt handlers are
+ * static, so small wrapper translation units include the sources and export
+ * what host tools need.
+ */
+
+#ifndef HOST_FIRMWARE_H
+#define HOST_FIRMWARE_H
+
+#include "memmap.h"
+
+/* main.c */
+void firmware_init(void);
+void firmware_service(void);
+servo_ctl_t* firmware_servos(void);
+bool firmware_commit_pending(void);
+
+/* servo.c */
+void firmware_timer0_a0(void);
+void firmware_timer0_a1(void);
+void firmware_timer1_a1(void);
+uint8_t firmware_pwm_pin(uint8_t servo);
+bool firmware_servo_level(uint16_t levels, uint8_t servo);
+void firmware_servo_unit(uint8_t servo, int* timer, int* ccr);
+uint16_t firmware_pwm_period(void);
+
+/* adc.c */
+void firmware_adc10(void);
+
+/* i2c_memdev.c */
+void firmware_usi_int(void);
+int firmware_i2c_state(void);
+const char* firmware_i2c_state_name(int state);
+
+#endif // HOST_FIRMWARE_H
@@ -0,0 +1,56 @@
+/*
+ * firmware_i2c.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "firmware.h"
+
+#include "../i2c_memdev.c"
+
+void firmware_usi_int(void)
+{
+    usi_int();
+}
+
+int firmware_i2c_state(void)
+{
+    return i2c_state.state;
+}
+
+const char* firmware_i2c_state_name(int state)
+{
+    switch((i2c_state_e)state)
+    {
+    case I2CS_IDLE: return "IDLE";
+    case I2CS_RXADDR: return "RXADDR";
+    case I2CS_RXADDR_DONE: return "RXADDR_DONE";
+    case I2CS_RXDATADDR: return "RXDATADDR";
+    case I2CS_RXDATADDR_DONE: return "RXDATADDR_DONE";
+    case I2CS_RX: return "RX";
+    case I2CS_RX_DONE: return "RX_DONE";
+    case I2CS_TX: return "TX";
+    case I2CS_TX_DONE: return "TX_DONE";
+    case I2CS_NACK_DONE: return "NACK_DONE";
+    }
+
+    return "?";
+}
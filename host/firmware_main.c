@@ -0,0 +1,59 @@
+/*
+ * firmware_main.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "firmware.h"
+
+#define main firmware_main
+#include "../main.c"
+#undef main
+
+/**
+ * @brief Runs the firmware's start-up, minus clock and port setup.
+ */
+void firmware_init(void)
+{
+    memmap_init();
+}
+
+/**
+ * @brief Runs one iteration of the firmware's main loop.
+ */
+void firmware_service(void)
+{
+    memmap_service();
+}
+
+servo_ctl_t* firmware_servos(void)
+{
+    return &shadow_servos;
+}
+
+/**
+ * @brief Tells whether the control word holds a commit that has not been
+ * applied yet (the firmware clears it once the transaction has ended).
+ */
+bool firmware_commit_pending(void)
+{
+    return control_word.commit == COMMIT_MAGIC_NUMBER;
+}
@@ -0,0 +1,89 @@
+/*
+ * firmware_servo.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "firmware.h"
+
+#include "../servo.c"
+
+void firmware_timer0_a0(void)
+{
+    ISR_timer0_a0();
+}
+
+void firmware_timer0_a1(void)
+{
+    ISR_timer0_a1();
+}
+
+void firmware_timer1_a1(void)
+{
+#if SERVO_TIMERS > 1
+    ISR_timer1_a1();
+#endif
+}
+
+uint8_t firmware_pwm_pin(uint8_t servo)
+{
+#ifdef SERVO_HW_PULSE
+    (void)servo;
+    return PWM_OUT_PIN;
+#else
+    return PWM_PINS[servo];
+#endif
+}
+
+/**
+ * @brief Gets the timer and compare register that end a channel's pulses.
+ */
+void firmware_servo_unit(uint8_t servo, int* timer, int* ccr)
+{
+    uint8_t lane = servo % SERVO_LANES;
+
+    *timer = lane / SERVO_CCRS;
+    *ccr = 1 + lane % SERVO_CCRS;
+}
+
+/**
+ * @brief Gets a channel's output level from the port pin levels, modelling the
+ * external demultiplexer in SERVO_HW_PULSE builds.
+ */
+bool firmware_servo_level(uint16_t levels, uint8_t servo)
+{
+#ifdef SERVO_HW_PULSE
+    uint8_t select = 0;
+
+    for(uint8_t i = 0; i < SERVO_DEMUX_BITS; i++)
+        if(levels & (1u << SERVO_DEMUX_PINS[i]))
+            select |= 1 << i;
+
+    return (levels & (1u << PWM_OUT_PIN)) && select == servo;
+#else
+    return levels & (1u << PWM_PINS[servo]);
+#endif
+}
+
+uint16_t firmware_pwm_period(void)
+{
+    return PWM_PERIOD;
+}
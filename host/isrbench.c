@@ -0,0 +1,288 @@
+/*
+ * isrbench.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Counts the instructions the servo slot interrupts execute: the current
+ * ones, which load a precomputed compare value unless the channel is dirty,
+ * against a copy of the slot ISR as it was before dirty tracking, which
+ * re-read the position, copied both bands and redid the clamp in every slot.
+ *
+ * Both run the same register-level code against the host register stand-ins,
+ * built with the host compiler, and a child process is single-stepped
+ * through each frame with ptrace, so the counts are exact and repeatable.
+ * They are host instructions, not MSP430 cycles, but both instruction sets
+ * take memory operands, so the ratio carries over reasonably well.
+ *
+ * usage: isrbench [-n frames]
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <msp430.h>
+
+#include "fakedev.h"
+#include "firmware.h"
+#include "simple_io.h"
+
+#if SERVO_LANES > 1
+#error "isrbench compares single-lane builds only"
+#endif
+
+bool get_busy_flag();
+
+typedef struct
+{
+    const char* name;
+    /* Channels whose setpoint changes every frame */
+    uint8_t moving;
+} bench_load_t;
+
+static const bench_load_t loads[] =
+{
+    { "steady", 0 },
+    { "1 moving", 0x01 },
+    { "all moving", SERVO_DIRTY_ALL },
+};
+
+static const uint8_t old_pins[NUM_SERVOS] = { 1, 2 };
+static servo_ctl_t old_buffer;
+static uint8_t old_servo;
+
+/* The slot start ISR before dirty tracking, from the original servo.c */
+__attribute__((noinline))
+static void old_timer0_a0(void)
+{
+    servo_ctl_t* servo_ctl = firmware_servos();
+    uint16_t current_servo_pos;
+
+    _BIC_SR(GIE);
+
+    old_servo++;
+    if(old_servo == NUM_SERVOS)
+        old_servo = 0;
+
+    set_pin(old_pins[old_servo]);
+
+    if(!get_busy_flag())
+    {
+        current_servo_pos = servo_ctl->pos[old_servo];
+        old_buffer.pos[old_servo] = current_servo_pos;
+        memcpy(&old_buffer.baseband, &servo_ctl->baseband, 4);
+    }
+    else
+    {
+        current_servo_pos = old_buffer.pos[old_servo];
+    }
+
+    uint16_t maxband_diff = old_buffer.maxband - old_buffer.baseband;
+    if(current_servo_pos > maxband_diff)
+        current_servo_pos = maxband_diff;
+
+    TA0CCR1 = old_buffer.baseband + current_servo_pos;
+
+    _BIS_SR_IRQ(GIE);
+}
+
+__attribute__((noinline))
+static void old_timer0_a1(void)
+{
+    _BIC_SR(GIE);
+
+    switch(TAIV)
+    {
+        case 0x02:
+            clear_pin(old_pins[old_servo]);
+            // The period values do not matter here
+            TA0CCR0 = (old_servo == 0) ? 1000 : 1250;
+            break;
+
+        default:
+            break;
+    }
+
+    _BIS_SR_IRQ(GIE);
+}
+
+/* Marks the start and end of a counted frame for the tracing parent */
+static void marker(void)
+{
+    raise(SIGSTOP);
+}
+
+static void frame(bool old, const bench_load_t* load)
+{
+    servo_ctl_t* ctl = firmware_servos();
+
+    // The master's update lands between frames, outside the count
+    for(uint8_t s = 0; s < NUM_SERVOS; s++)
+        if(load->moving & (1 << s))
+            ctl->pos[s] = (ctl->pos[s] + 7) % 500;
+    if(!old && load->moving)
+        servo_mark_dirty(load->moving);
+
+    marker();
+    for(uint8_t slot = 0; slot < SERVO_SLOTS; slot++)
+    {
+        if(old)
+        {
+            old_timer0_a0();
+            TAIV = 0x02;
+            old_timer0_a1();
+        }
+        else
+        {
+            firmware_timer0_a0();
+            TAIV = 0x02;
+            firmware_timer0_a1();
+        }
+    }
+    marker();
+}
+
+/* Traced side: an empty region for calibration, then every load both ways */
+static void child(unsigned frames)
+{
+    ptrace(PTRACE_TRACEME, 0, 0, 0);
+
+    fakedev_init();
+    firmware_service();
+    old_buffer = *firmware_servos();
+
+    marker();
+    marker();
+    marker();
+
+    for(size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); i++)
+    {
+        for(unsigned f = 0; f < frames; f++)
+            frame(true, &loads[i]);
+        for(unsigned f = 0; f < frames; f++)
+            frame(false, &loads[i]);
+    }
+
+    _exit(0);
+}
+
+/**
+ * @brief Runs the child to its next start marker, then single-steps it to
+ * the end marker.
+ *
+ * @return The number of instructions stepped, or -1 if the child is gone.
+ */
+static long count_region(pid_t pid)
+{
+    long n = 0;
+    int status;
+
+    if(ptrace(PTRACE_CONT, pid, 0, 0) < 0 || waitpid(pid, &status, 0) < 0 ||
+       !WIFSTOPPED(status))
+        return -1;
+
+    for(;;)
+    {
+        if(ptrace(PTRACE_SINGLESTEP, pid, 0, 0) < 0 ||
+           waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+            return -1;
+        if(WSTOPSIG(status) != SIGTRAP)
+            return n;
+        n++;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned frames = 50;
+    long base, n;
+    int opt, status;
+    pid_t pid;
+
+    while((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n':
+            frames = strtoul(optarg, 0, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n frames]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if(!frames)
+        frames = 1;
+
+    if((pid = fork()) == 0)
+        child(frames);
+
+    // The child stops at its first marker
+    if(pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFSTOPPED(status))
+    {
+        perror("trace");
+        return 1;
+    }
+
+    // The markers themselves, counted around an empty region
+    if((base = count_region(pid)) < 0)
+    {
+        fprintf(stderr, "trace: child lost\n");
+        return 1;
+    }
+
+    printf("host instructions per slot (start and end interrupt), "
+           "%u frames:\n", frames);
+    printf("%-12s %10s %10s %8s\n", "load", "before", "dirty", "ratio");
+
+    for(size_t i = 0; i < sizeof(loads) / sizeof(loads[0]); i++)
+    {
+        double per_slot[2];
+
+        for(int variant = 0; variant < 2; variant++)
+        {
+            long total = 0;
+
+            for(unsigned f = 0; f < frames; f++)
+            {
+                if((n = count_region(pid)) < 0)
+                {
+                    fprintf(stderr, "trace: child lost\n");
+                    return 1;
+                }
+                total += n - base;
+            }
+            per_slot[variant] = (double)total / (frames * SERVO_SLOTS);
+        }
+
+        printf("%-12s %10.1f %10.1f %8.2f\n", loads[i].name, per_slot[0],
+               per_slot[1], per_slot[1] / per_slot[0]);
+    }
+
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+
+    return 0;
+}
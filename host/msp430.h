@@ -0,0 +1,228 @@
+/*
+ * msp430.h
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Stand-in for the toolchain's <msp430.h> so the firmware sources build on a
+ * host. Peripheral registers are plain variables (defined in msp430_regs.c)
+ * that host code reads and writes around calls into the firmware; bit values
+ * match the MSP430x2xx family headers.
+ */
+
+#ifndef HOST_MSP430_H
+#define HOST_MSP430_H
+
+#include <stdint.h>
+
+/*
+ * The stand-in has the union of the peripherals the firmware uses, USI
+ * included, whatever the selected part
+ */
+#define __MSP430_HAS_USI__
+
+/* Interrupt handlers become ordinary functions */
+#define __interrupt__(vector) __used__
+
+#define PORT1_VECTOR        (2)
+#define PORT2_VECTOR        (3)
+#define USI_VECTOR          (4)
+#define ADC10_VECTOR        (5)
+#define TIMER1_A1_VECTOR    (12)
+#define TIMER1_A0_VECTOR    (13)
+#define TIMER0_A1_VECTOR    (8)
+#define TIMER0_A0_VECTOR    (9)
+
+/* Status register */
+#define GIE                 (0x0008)
+
+extern volatile uint16_t host_sr;
+
+#define _BIS_SR(x)          (host_sr |= (x))
+#define _BIC_SR(x)          (host_sr &= ~(x))
+#define _BIS_SR_IRQ(x)      (host_sr |= (x))
+#define _BIC_SR_IRQ(x)      (host_sr &= ~(x))
+#define __delay_cycles(x)   ((void)(x))
+
+#define HOST_REG8(name)     extern volatile uint8_t name
+#define HOST_REG16(name)    extern volatile uint16_t name
+
+/* Watchdog */
+HOST_REG16(WDTCTL);
+#define WDTPW               (0x5A00)
+#define WDTHOLD             (0x0080)
+
+/* Basic clock */
+HOST_REG8(DCOCTL);
+HOST_REG8(BCSCTL1);
+HOST_REG8(BCSCTL2);
+HOST_REG8(BCSCTL3);
+HOST_REG8(CALDCO_16MHZ);
+HOST_REG8(CALBC1_16MHZ);
+#define DIVS_0              (0x00)
+#define DIVS_1              (0x02)
+#define DIVS_2              (0x04)
+#define DIVS_3              (0x06)
+
+/* Ports */
+HOST_REG8(P1IN);
+HOST_REG8(P1OUT);
+HOST_REG8(P1DIR);
+HOST_REG8(P1SEL);
+HOST_REG8(P1REN);
+HOST_REG8(P2IN);
+HOST_REG8(P2OUT);
+HOST_REG8(P2DIR);
+HOST_REG8(P2SEL);
+HOST_REG8(P2REN);
+
+/* USI */
+HOST_REG8(USICTL0);
+HOST_REG8(USICTL1);
+HOST_REG8(USICKCTL);
+HOST_REG8(USICNT);
+HOST_REG8(USISRL);
+HOST_REG8(USISRH);
+
+#define USIPE7              (0x80)
+#define USIPE6              (0x40)
+#define USIPE5              (0x20)
+#define USILSB              (0x10)
+#define USIMST              (0x08)
+#define USIGE               (0x04)
+#define USIOE               (0x02)
+#define USISWRST            (0x01)
+
+#define USICKPH             (0x80)
+#define USII2C              (0x40)
+#define USISTTIE            (0x20)
+#define USIIE               (0x10)
+#define USIAL               (0x08)
+#define USISTP              (0x04)
+#define USISTTIFG           (0x02)
+#define USIIFG              (0x01)
+
+#define USICKPL             (0x02)
+#define USISWCLK            (0x01)
+
+#define USISCLREL           (0x80)
+#define USI16B              (0x40)
+#define USIIFGCC            (0x20)
+
+/* Timer_A (TA0 and TA1) */
+HOST_REG16(TA0CTL);
+HOST_REG16(TA0R);
+HOST_REG16(TA0IV);
+HOST_REG16(TA0CCTL0);
+HOST_REG16(TA0CCTL1);
+HOST_REG16(TA0CCTL2);
+HOST_REG16(TA0CCR0);
+HOST_REG16(TA0CCR1);
+HOST_REG16(TA0CCR2);
+HOST_REG16(TA1CTL);
+HOST_REG16(TA1R);
+HOST_REG16(TA1IV);
+HOST_REG16(TA1CCTL0);
+HOST_REG16(TA1CCTL1);
+HOST_REG16(TA1CCTL2);
+HOST_REG16(TA1CCR0);
+HOST_REG16(TA1CCR1);
+HOST_REG16(TA1CCR2);
+#define TAIV                TA0IV
+
+#define TASSEL_0            (0x0000)
+#define TASSEL_1            (0x0100)
+#define TASSEL_2            (0x0200)
+#define TASSEL_3            (0x0300)
+#define ID_0                (0x0000)
+#define ID_1                (0x0040)
+#define ID_2                (0x0080)
+#define ID_3                (0x00C0)
+#define MC_0                (0x0000)
+#define MC_1                (0x0010)
+#define MC_2                (0x0020)
+#define MC_3                (0x0030)
+#define TACLR               (0x0004)
+#define TAIE                (0x0002)
+#define TAIFG               (0x0001)
+
+#define CM_0                (0x0000)
+#define CCIS_0              (0x0000)
+#define SCS                 (0x0800)
+#define CAP                 (0x0100)
+#define OUTMOD_0            (0x0000)
+#define OUTMOD_1            (0x0020)
+#define OUTMOD_2            (0x0040)
+#define OUTMOD_3            (0x0060)
+#define OUTMOD_4            (0x0080)
+#define OUTMOD_5            (0x00A0)
+#define OUTMOD_6            (0x00C0)
+#define OUTMOD_7            (0x00E0)
+#define CCIE                (0x0010)
+#define CCI                 (0x0008)
+#define OUT                 (0x0004)
+#define COV                 (0x0002)
+#define CCIFG               (0x0001)
+
+/* ADC10 */
+HOST_REG16(ADC10CTL0);
+HOST_REG16(ADC10CTL1);
+HOST_REG8(ADC10AE0);
+HOST_REG8(ADC10DTC0);
+HOST_REG8(ADC10DTC1);
+HOST_REG16(ADC10MEM);
+HOST_REG16(ADC10SA);
+
+#define ADC10SC             (0x0001)
+#define ENC                 (0x0002)
+#define ADC10IFG            (0x0004)
+#define ADC10IE             (0x0008)
+#define ADC10ON             (0x0010)
+#define REFON               (0x0020)
+#define REF2_5V             (0x0040)
+#define MSC                 (0x0080)
+#define REFBURST            (0x0100)
+#define REFOUT              (0x0200)
+#define ADC10SR             (0x0400)
+#define ADC10SHT_0          (0x0000)
+#define ADC10SHT_1          (0x0800)
+#define ADC10SHT_2          (0x1000)
+#define ADC10SHT_3          (0x1800)
+#define SREF_0              (0x0000)
+
+#define ADC10BUSY           (0x0001)
+#define CONSEQ_0            (0x0000)
+#define CONSEQ_1            (0x0002)
+#define CONSEQ_2            (0x0004)
+#define CONSEQ_3            (0x0006)
+#define ADC10SSEL_0         (0x0000)
+#define ADC10SSEL_1         (0x0008)
+#define ADC10SSEL_2         (0x0010)
+#define ADC10SSEL_3         (0x0018)
+#define ADC10DIV_0          (0x0000)
+#define ADC10DIV_7          (0x00E0)
+#define ISSH                (0x0100)
+#define ADC10DF             (0x0200)
+#define SHS_0               (0x0000)
+#define SHS_1               (0x0400)
+#define SHS_2               (0x0800)
+#define SHS_3               (0x0C00)
+#define INCH_0              (0x0000)
+
+#endif // HOST_MSP430_H
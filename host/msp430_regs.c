@@ -0,0 +1,47 @@
+/*
+ * msp430_regs.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include <msp430.h>
+
+volatile uint16_t host_sr;
+
+volatile uint16_t WDTCTL;
+
+volatile uint8_t DCOCTL, BCSCTL1, BCSCTL2, BCSCTL3;
+volatile uint8_t CALDCO_16MHZ, CALBC1_16MHZ;
+
+volatile uint8_t P1IN, P1OUT, P1DIR, P1SEL, P1REN;
+volatile uint8_t P2IN, P2OUT, P2DIR, P2SEL, P2REN;
+
+volatile uint8_t USICTL0, USICTL1, USICKCTL, USICNT, USISRL, USISRH;
+
+volatile uint16_t TA0CTL, TA0R, TA0IV;
+volatile uint16_t TA0CCTL0, TA0CCTL1, TA0CCTL2;
+volatile uint16_t TA0CCR0, TA0CCR1, TA0CCR2;
+volatile uint16_t TA1CTL, TA1R, TA1IV;
+volatile uint16_t TA1CCTL0, TA1CCTL1, TA1CCTL2;
+volatile uint16_t TA1CCR0, TA1CCR1, TA1CCR2;
+
+volatile uint16_t ADC10CTL0, ADC10CTL1, ADC10MEM, ADC10SA;
+volatile uint8_t ADC10AE0, ADC10DTC0, ADC10DTC1;
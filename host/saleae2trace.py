@@ -0,0 +1,106 @@
+#!/usr/bin/python
+
+"""
+Converts the I2C analyzer export of Saleae Logic 2 (CSV, with the columns
+name, type, start_time, duration, ack, address, read and data) into the bus
+trace format read by servoreplay (see bustrace.h).
+
+Frames of type "start" open a message, "address" and "data" add to it and
+"stop" ends the transaction. A start without a stop before it is a repeated
+start. Transactions still open at the end of the capture are written with
+"nostop". Timestamps are made relative to the first start.
+"""
+
+import argparse, csv, sys
+
+def parse_int(s):
+    return int(s, 0) if s else 0
+
+def parse_bool(s):
+    return s.strip().lower() in ("true", "1", "yes")
+
+class Transaction:
+    def __init__(self, t_us):
+        self.t_us = t_us
+        self.msgs = []
+
+    def format(self, stop=True):
+        out = ["%d" % self.t_us]
+        for addr, read, addr_ack, data in self.msgs:
+            msg = "%s%02x%s:" % ("R" if read else "W", addr,
+                                 "" if addr_ack else "!")
+            for byte, ack in data:
+                # The master NACKs the last byte of a read, that is not an
+                # error. On writes a NACK comes from the device.
+                msg += "%02x%s" % (byte, "" if ack or read else "!")
+            out.append(msg)
+        if not stop:
+            out.append("nostop")
+        return " ".join(out)
+
+def convert(rows, out, addr_filter=None):
+    xact = None
+    t0 = None
+    count = 0
+
+    def flush(stop):
+        if xact and xact.msgs and (addr_filter is None or
+                                   any(m[0] == addr_filter
+                                       for m in xact.msgs)):
+            out.write(xact.format(stop) + "\n")
+            return 1
+        return 0
+
+    for row in rows:
+        kind = row["type"]
+        t = float(row["start_time"])
+        if t0 is None:
+            t0 = t
+        t_us = int(round((t - t0) * 1e6))
+
+        if kind == "start":
+            # A repeated start just opens the next message, on the address
+            if xact is None:
+                xact = Transaction(t_us)
+        elif kind == "address":
+            if xact is None:
+                xact = Transaction(t_us)
+            xact.msgs.append((parse_int(row["address"]),
+                              parse_bool(row["read"]),
+                              parse_bool(row["ack"]), []))
+        elif kind == "data":
+            if xact is None or not xact.msgs:
+                sys.stderr.write("warning: data at %.6f s outside of a "
+                                 "message, dropped\n" % t)
+                continue
+            xact.msgs[-1][3].append((parse_int(row["data"]),
+                                     parse_bool(row["ack"])))
+        elif kind == "stop":
+            count += flush(True)
+            xact = None
+    count += flush(False)
+    return count
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("--address", type=lambda s: int(s, 0),
+                    help="only keep transactions that talk to this 7-bit "
+                         "address")
+    ap.add_argument("-o", "--output")
+    ap.add_argument("csv")
+    args = ap.parse_args()
+
+    with open(args.csv) as f:
+        rows = csv.DictReader(f)
+        out = open(args.output, "w") if args.output else sys.stdout
+        try:
+            count = convert(rows, out, args.address)
+        finally:
+            if args.output:
+                out.close()
+
+    sys.stderr.write("%d transactions\n" % count)
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,514 @@
+/*
+ * servoctl.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "servoctl.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "i2c_memdev.h"
+
+/*
+ * Register addresses are sent as one byte, without selecting a page, so the
+ * map has to sit below I2C_PAGE_REG (which paged builds claim).
+ */
+_Static_assert(sizeof(memmap_t) <= I2C_PAGE_REG,
+               "memmap_t does not fit single-byte register addresses");
+
+typedef struct
+{
+    uint16_t start, len;
+} servoctl_run_t;
+
+/**
+ * @brief Opens a device on a bus and loads its current register map.
+ *
+ * @param dev The device handle to initialize.
+ * @param bus The bus backend; ownership passes to the handle.
+ * @param addr The 7-bit slave address (I2C_SLAVE_ADDR by default).
+ *
+ * @return 0, or a negative errno value if the device could not be read.
+ */
+int servoctl_open(servoctl_t* dev, servoctl_bus_t bus, uint8_t addr)
+{
+    memset(dev, 0, sizeof(*dev));
+    dev->bus = bus;
+    dev->addr = addr;
+    dev->max_gap = SERVOCTL_DEFAULT_MAX_GAP;
+
+    return servoctl_read(dev, 0);
+}
+
+void servoctl_close(servoctl_t* dev)
+{
+    if(dev->bus.close)
+        dev->bus.close(dev->bus.ctx);
+    dev->bus.close = 0;
+}
+
+/**
+ * @brief Performs raw messages as a single transaction and accounts for them.
+ */
+int servoctl_xfer(servoctl_t* dev, servoctl_msg_t* msgs, unsigned count)
+{
+    if(count > SERVOCTL_MAX_MSGS)
+        return -EINVAL;
+
+    dev->stats.transactions++;
+    dev->stats.messages += count;
+    for(unsigned i = 0; i < count; i++)
+        dev->stats.bytes += 1 + msgs[i].len;
+
+    return dev->bus.xfer(dev->bus.ctx, msgs, count);
+}
+
+/**
+ * @brief Stages raw register bytes for the next flush.
+ *
+ * Bytes equal to what the device is already known to hold are not marked for
+ * sending.
+ *
+ * @param dev The device.
+ * @param offset Offset into memmap_t.
+ * @param data The bytes, in device (little-endian) order.
+ * @param len The number of bytes.
+ *
+ * @return 0, or -EINVAL if the range is not writable.
+ */
+int servoctl_stage(servoctl_t* dev, uint16_t offset, const void* data,
+                   uint16_t len)
+{
+    uint8_t* shadow = (uint8_t*)&dev->shadow;
+    const uint8_t* src = data;
+
+    if(offset + len > MEMMAP_WRITABLE_LEN)
+        return -EINVAL;
+
+    for(uint16_t i = 0; i < len; i++)
+    {
+        if(shadow[offset + i] != src[i])
+        {
+            shadow[offset + i] = src[i];
+            dev->dirty[offset + i] = true;
+        }
+    }
+
+    return 0;
+}
+
+static int servoctl_stage_u16(servoctl_t* dev, uint16_t offset, uint16_t val)
+{
+    uint8_t le[2] = { val & 0xFF, val >> 8 };
+    return servoctl_stage(dev, offset, le, sizeof(le));
+}
+
+int servoctl_set_pos(servoctl_t* dev, uint8_t servo, uint16_t pos)
+{
+    if(servo >= NUM_SERVOS)
+        return -EINVAL;
+
+    return servoctl_stage_u16(dev, offsetof(memmap_t, servos.pos) +
+                              servo * sizeof(uint16_t), pos);
+}
+
+int servoctl_set_bands(servoctl_t* dev, uint16_t baseband, uint16_t maxband)
+{
+    int ret = servoctl_stage_u16(dev, offsetof(memmap_t, servos.baseband),
+                                 baseband);
+    if(ret)
+        return ret;
+
+    return servoctl_stage_u16(dev, offsetof(memmap_t, servos.maxband),
+                              maxband);
+}
+
+int servoctl_set_refresh(servoctl_t* dev, uint8_t servo, uint8_t div)
+{
+    if(servo >= NUM_SERVOS)
+        return -EINVAL;
+
+    return servoctl_stage(dev, offsetof(memmap_t, servos.refresh_div) + servo,
+                          &div, 1);
+}
+
+/**
+ * @brief Finds the ranges of dirty bytes, merging ranges separated by at most
+ * max_gap clean bytes.
+ *
+ * @return The number of ranges written to runs.
+ */
+static unsigned servoctl_runs(servoctl_t* dev, servoctl_run_t* runs)
+{
+    unsigned n = 0;
+    uint16_t i = 0;
+
+    while(i < MEMMAP_WRITABLE_LEN)
+    {
+        if(!dev->dirty[i])
+        {
+            i++;
+            continue;
+        }
+
+        uint16_t start = i, end = i + 1;
+        unsigned gap = 0;
+
+        for(i++; i < MEMMAP_WRITABLE_LEN; i++)
+        {
+            if(dev->dirty[i])
+            {
+                end = i + 1;
+                gap = 0;
+            }
+            else if(++gap > dev->max_gap)
+            {
+                break;
+            }
+        }
+
+        runs[n].start = start;
+        runs[n].len = end - start;
+        n++;
+
+        i = end;
+    }
+
+    return n;
+}
+
+/**
+ * @brief Sends all staged updates and commits them.
+ *
+ * Everything goes out as one transaction (one I2C_RDWR on Linux), with the
+ * commit word merged into the nearest burst. The firmware holds off applying
+ * the map until the transaction ends, so the update is atomic.
+ *
+ * @return 0, or a negative errno value from the bus.
+ */
+int servoctl_flush(servoctl_t* dev)
+{
+    servoctl_run_t runs[MEMMAP_WRITABLE_LEN];
+    servoctl_msg_t msgs[SERVOCTL_MAX_MSGS];
+    uint8_t pool[MEMMAP_WRITABLE_LEN + SERVOCTL_MAX_MSGS];
+    const uint8_t* shadow = (const uint8_t*)&dev->shadow;
+    unsigned n, count = 0, used = 0;
+    bool split;
+    int ret;
+
+    for(n = 0; n < MEMMAP_WRITABLE_LEN && !dev->dirty[n]; n++);
+    if(n == MEMMAP_WRITABLE_LEN)
+        return 0;
+
+    dev->shadow.control_word.commit = COMMIT_MAGIC_NUMBER;
+    dev->dirty[offsetof(memmap_t, control_word)] = true;
+
+    n = servoctl_runs(dev, runs);
+
+    /*
+     * If the update needs more than one transaction, the commit has to go
+     * last, on its own.
+     */
+    split = (n > SERVOCTL_MAX_MSGS);
+    if(split)
+    {
+        dev->dirty[offsetof(memmap_t, control_word)] = false;
+        n = servoctl_runs(dev, runs);
+    }
+
+    for(unsigned i = 0; i <= n; i++)
+    {
+        bool last = (i == n);
+
+        if(last && split)
+        {
+            runs[i].start = offsetof(memmap_t, control_word);
+            runs[i].len = 1;
+        }
+        else if(last)
+        {
+            break;
+        }
+
+        msgs[count].addr = dev->addr;
+        msgs[count].flags = 0;
+        msgs[count].len = runs[i].len + 1;
+        msgs[count].buf = &pool[used];
+
+        pool[used] = runs[i].start;
+        memcpy(&pool[used + 1], &shadow[runs[i].start], runs[i].len);
+        used += runs[i].len + 1;
+        count++;
+
+        if(count == SERVOCTL_MAX_MSGS || last || (!split && i == n - 1))
+        {
+            ret = servoctl_xfer(dev, msgs, count);
+            if(ret)
+                return ret;
+            count = 0;
+            used = 0;
+        }
+    }
+
+    memset(dev->dirty, 0, sizeof(dev->dirty));
+
+    // The firmware clears the commit once it has applied the update
+    dev->shadow.control_word.commit = 0;
+
+    return 0;
+}
+
+#ifdef SERVO_COMMANDS
+/**
+ * @brief Predicts what a command leaves in a position, from the local copy.
+ */
+static uint16_t servoctl_command_pos(const servoctl_t* dev, uint8_t op,
+                                    uint16_t pos, int16_t value)
+{
+    const servo_ctl_t* servos = &dev->shadow.servos;
+    uint16_t band = (servos->maxband > servos->baseband)
+                  ? (servos->maxband - servos->baseband) : 0;
+    int32_t r = value;
+
+    if(op == SERVO_CMD_SWAP)
+        return value;
+    if(op == SERVO_CMD_ADD)
+        r += pos;
+
+    return (r < 0) ? 0 : ((r > band) ? band : r);
+}
+
+/**
+ * @brief Runs a command from the command block (see servo_cmd_t).
+ *
+ * The command takes effect immediately and is independent of staged updates;
+ * the local copy of the positions it changed is updated unless they are
+ * staged.
+ *
+ * @param dev The device.
+ * @param op One of the SERVO_CMD_ operations.
+ * @param target The channel, or the channel mask for SERVO_CMD_SET_MASK.
+ * @param value The operand.
+ * @param result If not null, the status and result are read back in the same
+ * transaction, and result receives the latter. Otherwise only the command is
+ * written, and its outcome is predicted from the local copy.
+ *
+ * @return 0, -EINVAL if the device rejected the command (or it would), or a
+ * negative errno value from the bus.
+ */
+int servoctl_command(servoctl_t* dev, uint8_t op, uint8_t target,
+                     int16_t value, uint16_t* result)
+{
+    uint8_t cmd[5] = { offsetof(memmap_t, command), value & 0xFF,
+                       (uint16_t)value >> 8, target, op };
+    uint8_t reg = offsetof(memmap_t, command.op);
+    uint8_t status[3];
+    servoctl_msg_t msgs[3] = {
+        { dev->addr, 0, sizeof(cmd), cmd },
+        { dev->addr, 0, 1, &reg },
+        { dev->addr, SERVOCTL_MSG_READ, sizeof(status), status },
+    };
+    uint8_t mask;
+    uint16_t res = 0;
+    int ret;
+
+    if(op == SERVO_CMD_SET_MASK)
+        mask = target & SERVO_DIRTY_ALL;
+    else
+        mask = (target < NUM_SERVOS) ? (1 << target) : 0;
+
+    if(!mask || op < SERVO_CMD_ADD || op > SERVO_CMD_SET_MASK)
+        return -EINVAL;
+
+    ret = servoctl_xfer(dev, msgs, result ? 3 : 1);
+    if(ret)
+        return ret;
+
+    if(result)
+    {
+        if(status[0] != SERVO_CMD_DONE)
+            return -EINVAL;
+        res = status[1] | (status[2] << 8);
+        *result = res;
+    }
+
+    for(uint8_t i = 0; i < NUM_SERVOS; i++)
+    {
+        size_t offset = offsetof(memmap_t, servos.pos) + i * sizeof(uint16_t);
+        uint16_t* pos = &dev->shadow.servos.pos[i];
+
+        if(!(mask & (1 << i)) || dev->dirty[offset] || dev->dirty[offset + 1])
+            continue;
+
+        if(result && op != SERVO_CMD_SWAP)
+            *pos = res;
+        else
+            *pos = servoctl_command_pos(dev, op, *pos, value);
+    }
+
+    return 0;
+}
+#endif
+
+/**
+ * @brief Reads the whole register map and checks the driver's checksum.
+ *
+ * The local copy is refreshed with the device's values, except for bytes that
+ * are staged but not flushed yet.
+ *
+ * @param dev The device.
+ * @param map If not null, receives the register map.
+ *
+ * @return 0, -EBADMSG on a checksum mismatch, or a negative errno value from
+ * the bus.
+ */
+int servoctl_read(servoctl_t* dev, memmap_t* map)
+{
+    uint8_t reg = 0;
+    uint8_t buf[sizeof(memmap_t) + 1];
+    uint8_t chksum = I2C_CHECKSUM_MAGIC;
+    uint8_t* shadow = (uint8_t*)&dev->shadow;
+    servoctl_msg_t msgs[2] = {
+        { dev->addr, 0, 1, &reg },
+        { dev->addr, SERVOCTL_MSG_READ, sizeof(buf), buf },
+    };
+    int ret;
+
+    ret = servoctl_xfer(dev, msgs, 2);
+    if(ret)
+        return ret;
+
+    // The driver sends the checksum once the master reads past the end
+    for(size_t i = 0; i < sizeof(memmap_t); i++)
+        chksum ^= buf[i];
+    if(chksum != buf[sizeof(memmap_t)])
+        return -EBADMSG;
+
+    for(size_t i = 0; i < sizeof(memmap_t); i++)
+        if(i >= MEMMAP_WRITABLE_LEN || !dev->dirty[i])
+            shadow[i] = buf[i];
+
+    if(map)
+        memcpy(map, buf, sizeof(memmap_t));
+
+    return 0;
+}
+
+#ifdef ATTENTION_LINE
+/**
+ * @brief Selects the events that assert the attention line.
+ *
+ * @param dev The device.
+ * @param events Bitmask of ATTN_ events.
+ * @param adc_delta How far a pot has to move to raise ATTN_ADC.
+ * @param adc_threshold Reading a pot crosses to raise ATTN_ADC_LEVEL.
+ *
+ * @return 0, or a negative errno value from the bus.
+ */
+int servoctl_attention_enable(servoctl_t* dev, uint8_t events,
+                              uint16_t adc_delta, uint16_t adc_threshold)
+{
+    uint8_t buf[1 + ATTENTION_WRITABLE_LEN] = {
+        offsetof(memmap_t, attention), events, 0,
+        adc_delta & 0xFF, adc_delta >> 8,
+        adc_threshold & 0xFF, adc_threshold >> 8
+    };
+    servoctl_msg_t msg = { dev->addr, 0, sizeof(buf), buf };
+    int ret;
+
+    ret = servoctl_xfer(dev, &msg, 1);
+    if(ret)
+        return ret;
+
+    dev->shadow.attention.enable = events;
+    dev->shadow.attention.adc_delta = adc_delta;
+    dev->shadow.attention.adc_threshold = adc_threshold;
+
+    return 0;
+}
+
+/**
+ * @brief Reads and acknowledges the pending attention events, e.g. from the
+ * handler of the line's falling edge.
+ *
+ * The line is held low for as long as any enabled event is pending, so an
+ * event raised between the read and the acknowledge would keep it low and
+ * never give another edge. Each acknowledge therefore re-reads the status in
+ * the same transaction, and this returns once it reads 0, with the line
+ * released. Events that are raised faster than they can be acknowledged would
+ * keep it going forever, so it stops after SERVOCTL_ATTENTION_MAX_PASSES
+ * acknowledges; the caller should service again later (e.g. after disabling
+ * the event that keeps coming).
+ *
+ * @param dev The device.
+ * @param events Receives the bitmask of ATTN_ events that were pending and
+ *               acknowledged.
+ *
+ * @return 0 with the line released, -EAGAIN if events were still pending
+ *         after the last pass, or a negative errno value from the bus.
+ */
+int servoctl_attention_service(servoctl_t* dev, uint8_t* events)
+{
+    uint8_t reg = offsetof(memmap_t, attention.status);
+    uint8_t ack[2] = { offsetof(memmap_t, attention.ack) };
+    uint8_t status;
+    servoctl_msg_t msgs[3] = {
+        { dev->addr, 0, sizeof(ack), ack },
+        { dev->addr, 0, 1, &reg },
+        { dev->addr, SERVOCTL_MSG_READ, 1, &status },
+    };
+    int ret;
+
+    *events = 0;
+
+    // W[status] Sr R[1], then W[ack, status] Sr W[status] Sr R[1] until clear
+    ret = servoctl_xfer(dev, &msgs[1], 2);
+    for(int pass = 0; !ret && status; pass++)
+    {
+        if(pass == SERVOCTL_ATTENTION_MAX_PASSES)
+            return -EAGAIN;
+
+        *events |= status;
+        ack[1] = status;
+        ret = servoctl_xfer(dev, msgs, 3);
+    }
+
+    return ret;
+}
+#endif
+
+/**
+ * @brief Estimates the time the counted traffic occupies the bus.
+ *
+ * Each byte takes nine clocks (eight bits and the acknowledge); each message
+ * adds a start or repeated start and each transaction a stop.
+ */
+unsigned long servoctl_bus_time_us(const servoctl_stats_t* stats,
+                                   unsigned long bus_hz)
+{
+    unsigned long long clocks = 9ull * stats->bytes + stats->messages +
+                                stats->transactions;
+
+    return (unsigned long)(clocks * 1000000ull / bus_hz);
+}
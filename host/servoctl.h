@@ -0,0 +1,129 @@
+/*
+ * servoctl.h
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Host-side master library for the servo controller. The register layout comes
+ * straight from the firmware's memmap.h. Updates are staged in a local copy of
+ * the map and sent by servoctl_flush() as a single combined transaction:
+ * dirty ranges are coalesced into burst writes and the commit word rides
+ * along, so the device applies everything at once.
+ */
+
+#ifndef SERVOCTL_H
+#define SERVOCTL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "memmap.h"
+
+/* Largest number of messages the bus backends take in one transaction */
+#define SERVOCTL_MAX_MSGS (42)
+
+/*
+ * Dirty ranges separated by at most this many clean bytes are merged into one
+ * burst; re-sending a couple of bytes is cheaper than another start condition,
+ * address byte and register byte.
+ */
+#define SERVOCTL_DEFAULT_MAX_GAP (2)
+
+/*
+ * Acknowledges servoctl_attention_service() sends before giving up on events
+ * that keep arriving (e.g. ATTN_FRAME every frame); it returns -EAGAIN then,
+ * with the line still asserted.
+ */
+#define SERVOCTL_ATTENTION_MAX_PASSES (4)
+
+#define SERVOCTL_MSG_READ (0x0001)
+
+typedef struct
+{
+    uint16_t addr;
+    uint16_t flags;
+    uint16_t len;
+    uint8_t* buf;
+} servoctl_msg_t;
+
+/*
+ * A bus backend. xfer() performs the messages as one transaction: a start,
+ * repeated starts between messages and a stop at the end. Returns 0 or a
+ * negative errno value.
+ */
+typedef struct
+{
+    int (*xfer)(void* ctx, servoctl_msg_t* msgs, unsigned count);
+    void (*close)(void* ctx);
+    void* ctx;
+} servoctl_bus_t;
+
+typedef struct
+{
+    unsigned long transactions;
+    unsigned long messages;
+    /* Bytes on the wire, including address bytes */
+    unsigned long bytes;
+} servoctl_stats_t;
+
+typedef struct
+{
+    servoctl_bus_t bus;
+    uint8_t addr;
+    unsigned max_gap;
+
+    /* Local copy of the register map and which of its bytes need sending */
+    memmap_t shadow;
+    bool dirty[sizeof(memmap_t)];
+
+    servoctl_stats_t stats;
+} servoctl_t;
+
+int servoctl_bus_i2cdev(servoctl_bus_t* bus, const char* path);
+int servoctl_bus_fake(servoctl_bus_t* bus);
+
+int servoctl_open(servoctl_t* dev, servoctl_bus_t bus, uint8_t addr);
+void servoctl_close(servoctl_t* dev);
+
+int servoctl_xfer(servoctl_t* dev, servoctl_msg_t* msgs, unsigned count);
+
+int servoctl_stage(servoctl_t* dev, uint16_t offset, const void* data,
+                   uint16_t len);
+int servoctl_set_pos(servoctl_t* dev, uint8_t servo, uint16_t pos);
+int servoctl_set_bands(servoctl_t* dev, uint16_t baseband, uint16_t maxband);
+int servoctl_set_refresh(servoctl_t* dev, uint8_t servo, uint8_t div);
+int servoctl_flush(servoctl_t* dev);
+
+#ifdef SERVO_COMMANDS
+int servoctl_command(servoctl_t* dev, uint8_t op, uint8_t target,
+                     int16_t value, uint16_t* result);
+#endif
+
+int servoctl_read(servoctl_t* dev, memmap_t* map);
+
+#ifdef ATTENTION_LINE
+int servoctl_attention_enable(servoctl_t* dev, uint8_t events,
+                              uint16_t adc_delta, uint16_t adc_threshold);
+int servoctl_attention_service(servoctl_t* dev, uint8_t* events);
+#endif
+
+unsigned long servoctl_bus_time_us(const servoctl_stats_t* stats,
+                                   unsigned long bus_hz);
+
+#endif // SERVOCTL_H
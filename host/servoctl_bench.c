@@ -0,0 +1,268 @@
+/*
+ * servoctl_bench.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Compares per-field register writes against servoctl_flush() batching. By
+ * default it runs against the in-process fake device, so it needs no
+ * hardware; pass an i2c-dev path to run it against a real bus. -r records
+ * the traffic in the bus trace format, for servoreplay.
+ *
+ * usage: servoctl_bench [-n updates] [-c channels per update] [-r trace]
+ *                       [/dev/i2c-N]
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bustrace.h"
+#include "servoctl.h"
+
+typedef struct
+{
+    const char* name;
+    servoctl_stats_t stats;
+    double wall_us;
+} bench_result_t;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* One transaction per field, then one for the commit */
+static int update_naive(servoctl_t* dev, const uint16_t* pos,
+                        const uint16_t* prev, unsigned channels)
+{
+    for(unsigned i = 0; i < channels; i++)
+    {
+        uint8_t buf[3] = { offsetof(memmap_t, servos.pos) + i * 2,
+                           pos[i] & 0xFF, pos[i] >> 8 };
+        servoctl_msg_t msg = { dev->addr, 0, sizeof(buf), buf };
+        int ret = servoctl_xfer(dev, &msg, 1);
+        if(ret)
+            return ret;
+    }
+
+    uint8_t commit[2] = { offsetof(memmap_t, control_word),
+                          COMMIT_MAGIC_NUMBER };
+    servoctl_msg_t msg = { dev->addr, 0, sizeof(commit), commit };
+    return servoctl_xfer(dev, &msg, 1);
+}
+
+static int update_batched(servoctl_t* dev, const uint16_t* pos,
+                          const uint16_t* prev, unsigned channels)
+{
+    for(unsigned i = 0; i < channels; i++)
+        servoctl_set_pos(dev, i, pos[i]);
+
+    return servoctl_flush(dev);
+}
+
+/* Relative moves: read the positions, add, then write them back batched */
+static int update_rmw(servoctl_t* dev, const uint16_t* pos,
+                      const uint16_t* prev, unsigned channels)
+{
+    uint8_t reg = offsetof(memmap_t, servos.pos);
+    uint8_t buf[NUM_SERVOS * 2];
+    servoctl_msg_t msgs[2] = {
+        { dev->addr, 0, 1, &reg },
+        { dev->addr, SERVOCTL_MSG_READ, channels * 2, buf },
+    };
+    int ret = servoctl_xfer(dev, msgs, 2);
+    if(ret)
+        return ret;
+
+    for(unsigned i = 0; i < channels; i++)
+    {
+        uint16_t cur = buf[i * 2] | (buf[i * 2 + 1] << 8);
+        servoctl_set_pos(dev, i, cur + (pos[i] - prev[i]));
+    }
+
+    return servoctl_flush(dev);
+}
+
+#ifdef SERVO_COMMANDS
+/* Relative moves with the on-device add command, one transaction each */
+static int update_command(servoctl_t* dev, const uint16_t* pos,
+                          const uint16_t* prev, unsigned channels)
+{
+    for(unsigned i = 0; i < channels; i++)
+    {
+        int ret = servoctl_command(dev, SERVO_CMD_ADD, i, pos[i] - prev[i],
+                                   0);
+        if(ret)
+            return ret;
+    }
+
+    return 0;
+}
+#endif
+
+static int run(servoctl_t* dev, bench_result_t* res, unsigned updates,
+               unsigned channels,
+               int (*update)(servoctl_t*, const uint16_t*, const uint16_t*,
+                             unsigned))
+{
+    uint16_t pos[NUM_SERVOS], prev[NUM_SERVOS];
+    memmap_t map;
+    double start;
+    int ret;
+
+    // Relative updates start from where the device is
+    ret = servoctl_read(dev, &map);
+    if(ret)
+        return ret;
+    memcpy(prev, map.servos.pos, sizeof(prev));
+
+    memset(&dev->stats, 0, sizeof(dev->stats));
+    start = now_us();
+
+    for(unsigned u = 0; u < updates; u++)
+    {
+        for(unsigned i = 0; i < channels; i++)
+            pos[i] = (u * 7 + i * 131) % 500;
+
+        ret = update(dev, pos, prev, channels);
+        if(ret)
+            return ret;
+        memcpy(prev, pos, sizeof(prev));
+    }
+
+    res->wall_us = now_us() - start;
+    res->stats = dev->stats;
+
+    // Check that the last update landed
+    ret = servoctl_read(dev, &map);
+    if(ret)
+        return ret;
+    for(unsigned i = 0; i < channels; i++)
+        if(map.servos.pos[i] != pos[i])
+            return -EIO;
+
+    return 0;
+}
+
+static void report(const bench_result_t* res, unsigned updates)
+{
+    printf("%-8s %8.2f %8.2f %8.2f %10lu %10lu %10.2f\n", res->name,
+           (double)res->stats.transactions / updates,
+           (double)res->stats.messages / updates,
+           (double)res->stats.bytes / updates,
+           servoctl_bus_time_us(&res->stats, 100000) / updates,
+           servoctl_bus_time_us(&res->stats, 400000) / updates,
+           res->wall_us / updates);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned updates = 10000, channels = NUM_SERVOS;
+    servoctl_bus_t bus;
+    servoctl_t dev;
+    FILE* trace = 0;
+    bench_result_t naive = { "naive" }, batched = { "batched" };
+    bench_result_t rmw = { "rmw" };
+#ifdef SERVO_COMMANDS
+    bench_result_t command = { "command" };
+#endif
+    int opt, ret;
+
+    while((opt = getopt(argc, argv, "n:c:r:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'n':
+            updates = strtoul(optarg, 0, 0);
+            break;
+        case 'c':
+            channels = strtoul(optarg, 0, 0);
+            break;
+        case 'r':
+            if(!(trace = fopen(optarg, "w")))
+            {
+                perror(optarg);
+                return 1;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n updates] [-c channels] "
+                    "[-r trace] [/dev/i2c-N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if(!updates || !channels || channels > NUM_SERVOS)
+    {
+        fprintf(stderr, "need 1..%d channels and at least one update\n",
+                NUM_SERVOS);
+        return 2;
+    }
+
+    ret = (optind < argc) ? servoctl_bus_i2cdev(&bus, argv[optind])
+                          : servoctl_bus_fake(&bus);
+    if(!ret && trace)
+        ret = servoctl_bus_record(&bus, bus, trace);
+    if(!ret)
+        ret = servoctl_open(&dev, bus, I2C_SLAVE_ADDR);
+    if(ret)
+    {
+        fprintf(stderr, "open: %s\n", strerror(-ret));
+        return 1;
+    }
+
+    ret = run(&dev, &naive, updates, channels, update_naive);
+    if(!ret)
+        ret = run(&dev, &batched, updates, channels, update_batched);
+    if(!ret)
+        ret = run(&dev, &rmw, updates, channels, update_rmw);
+#ifdef SERVO_COMMANDS
+    if(!ret)
+        ret = run(&dev, &command, updates, channels, update_command);
+#endif
+    if(ret)
+    {
+        fprintf(stderr, "update: %s\n", strerror(-ret));
+        servoctl_close(&dev);
+        return 1;
+    }
+
+    printf("%u updates of %u channel(s), per update:\n", updates, channels);
+    printf("%-8s %8s %8s %8s %10s %10s %10s\n", "mode", "xfers", "msgs",
+           "bytes", "us@100k", "us@400k", "host us");
+    report(&naive, updates);
+    report(&batched, updates);
+    printf("relative moves:\n");
+    report(&rmw, updates);
+#ifdef SERVO_COMMANDS
+    report(&command, updates);
+#endif
+
+    servoctl_close(&dev);
+    if(trace)
+        fclose(trace);
+    return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * servoctl_i2cdev.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Linux i2c-dev backend. Each transaction is a single I2C_RDWR ioctl, so the
+ * kernel issues repeated starts between the messages.
+ */
+
+#include "servoctl.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+static int i2cdev_xfer(void* ctx, servoctl_msg_t* msgs, unsigned count)
+{
+    struct i2c_msg m[SERVOCTL_MAX_MSGS];
+    struct i2c_rdwr_ioctl_data data = { m, count };
+
+    if(count > SERVOCTL_MAX_MSGS)
+        return -EINVAL;
+
+    for(unsigned i = 0; i < count; i++)
+    {
+        m[i].addr = msgs[i].addr;
+        m[i].flags = (msgs[i].flags & SERVOCTL_MSG_READ) ? I2C_M_RD : 0;
+        m[i].len = msgs[i].len;
+        m[i].buf = msgs[i].buf;
+    }
+
+    if(ioctl((int)(intptr_t)ctx, I2C_RDWR, &data) < 0)
+        return -errno;
+
+    return 0;
+}
+
+static void i2cdev_close(void* ctx)
+{
+    close((int)(intptr_t)ctx);
+}
+
+/**
+ * @brief Opens an i2c-dev bus, e.g. /dev/i2c-1.
+ *
+ * @return 0, or a negative errno value.
+ */
+int servoctl_bus_i2cdev(servoctl_bus_t* bus, const char* path)
+{
+    int fd = open(path, O_RDWR);
+
+    if(fd < 0)
+        return -errno;
+
+    bus->xfer = i2cdev_xfer;
+    bus->close = i2cdev_close;
+    bus->ctx = (void*)(intptr_t)fd;
+
+    return 0;
+}
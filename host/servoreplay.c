@@ -0,0 +1,334 @@
+/*
+ * servoreplay.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Replays a bus trace (see bustrace.h) into the host build of the firmware,
+ * byte by byte through the same USI model as the fake device, so partial
+ * writes, missing stops and NACKed bytes reach usi_int() exactly as they
+ * happened. Between transactions the peripheral model in sim.c runs the
+ * firmware's interrupts and main loop up to the next timestamp, so the result
+ * is deterministic whatever the replay speed.
+ *
+ * It reports setpoint changes as commits apply them (positions written without
+ * a commit are not reported until one follows), device ACK/NACK and read data
+ * that differ from the capture, and transactions that leave the driver busy
+ * after their stop.
+ * With -v it also prints every transaction with the driver states it went
+ * through.
+ *
+ * usage: servoreplay [-s speed] [-b bus_hz] [-v] trace
+ *
+ * A speed of 0 (the default) replays as fast as possible; 1 keeps the
+ * capture's timing, 10 runs ten times faster.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bustrace.h"
+#include "fakedev.h"
+#include "firmware.h"
+#include "i2c_memdev.h"
+#include "sim.h"
+
+#define STATE_PATH_LEN (256)
+
+typedef struct
+{
+    unsigned long transactions, messages, bytes;
+    unsigned long ack_mismatches, data_mismatches;
+    unsigned long stuck_busy;
+    unsigned long setpoint_changes;
+} replay_stats_t;
+
+static replay_stats_t stats;
+static bool verbose;
+
+/* Driver states visited during the current transaction */
+static char state_path[STATE_PATH_LEN];
+static int last_state;
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void note_state(void)
+{
+    int state = firmware_i2c_state();
+    size_t len = strlen(state_path);
+
+    if(state == last_state)
+        return;
+    last_state = state;
+
+    snprintf(state_path + len, sizeof(state_path) - len, " %s",
+             firmware_i2c_state_name(state));
+}
+
+static void report(uint64_t t_us, const char* fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void report(uint64_t t_us, const char* fmt, ...)
+{
+    va_list ap;
+
+    printf("%12.3f ms  ", t_us / 1000.0);
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    putchar('\n');
+}
+
+static void check_ack(uint64_t t_us, unsigned msg, int byte, bool acked,
+                      bool expect_nack)
+{
+    if(acked != expect_nack)
+        return;
+
+    stats.ack_mismatches++;
+    if(byte < 0)
+        report(t_us, "message %u: address %s, capture says %s", msg,
+               acked ? "ACKed" : "NACKed", acked ? "NACK" : "ACK");
+    else
+        report(t_us, "message %u byte %d: %s, capture says %s", msg, byte,
+               acked ? "ACKed" : "NACKed", acked ? "NACK" : "ACK");
+}
+
+static void replay_msg(uint64_t t_us, unsigned n, const bustrace_msg_t* msg)
+{
+    bool acked;
+
+    fakedev_start();
+    note_state();
+
+    acked = fakedev_write((msg->addr << 1) | (msg->read ? 1 : 0));
+    note_state();
+    check_ack(t_us, n, -1, acked, msg->addr_nack);
+
+    for(uint16_t i = 0; i < msg->len; i++)
+    {
+        if(msg->read)
+        {
+            uint8_t byte = fakedev_read(i + 1 < msg->len);
+
+            if(msg->known[i] && byte != msg->buf[i])
+            {
+                stats.data_mismatches++;
+                report(t_us, "message %u byte %u: read 0x%02x, capture has "
+                       "0x%02x", n, i, byte, msg->buf[i]);
+            }
+        }
+        else
+        {
+            acked = fakedev_write(msg->buf[i]);
+            check_ack(t_us, n, i, acked, msg->nack[i]);
+        }
+        note_state();
+    }
+
+    stats.messages++;
+    stats.bytes += 1 + msg->len;
+}
+
+/* Set once a commit has been written, until the firmware applies it */
+static bool commit_seen;
+
+static void report_setpoints(uint64_t t_us, servo_ctl_t* prev)
+{
+    const servo_ctl_t* cur = firmware_servos();
+
+    // The registers hold uncommitted writes too; wait for the commit
+    if(!commit_seen || firmware_commit_pending())
+        return;
+    commit_seen = false;
+
+    for(int i = 0; i < NUM_SERVOS; i++)
+    {
+        if(cur->pos[i] != prev->pos[i])
+            report(t_us, "pos[%d] %u -> %u", i, prev->pos[i], cur->pos[i]);
+        if(cur->refresh_div[i] != prev->refresh_div[i])
+            report(t_us, "refresh_div[%d] %u -> %u", i, prev->refresh_div[i],
+                   cur->refresh_div[i]);
+    }
+    if(cur->baseband != prev->baseband || cur->maxband != prev->maxband)
+        report(t_us, "bands %u..%u -> %u..%u", prev->baseband, prev->maxband,
+               cur->baseband, cur->maxband);
+
+    if(memcmp(cur, prev, sizeof(*prev)))
+    {
+        stats.setpoint_changes++;
+        *prev = *cur;
+    }
+}
+
+static void replay(const bustrace_xact_t* xact, unsigned long bus_hz,
+                   servo_ctl_t* setpoints)
+{
+    unsigned long bytes = stats.bytes;
+
+    state_path[0] = 0;
+    last_state = -1;
+
+    for(unsigned i = 0; i < xact->count; i++)
+    {
+        replay_msg(xact->t_us, i, &xact->msgs[i]);
+        commit_seen |= firmware_commit_pending();
+    }
+
+    if(xact->stop)
+    {
+        fakedev_stop();
+        note_state();
+
+        if(i2c_busy())
+        {
+            stats.stuck_busy++;
+            report(xact->t_us, "driver still busy after stop (state %s)",
+                   firmware_i2c_state_name(firmware_i2c_state()));
+        }
+    }
+
+    if(verbose)
+    {
+        printf("%12.3f ms  ", xact->t_us / 1000.0);
+        bustrace_write(stdout, xact);
+        printf("%16s%s\n", "", state_path);
+    }
+
+    sim_after_firmware();
+    sim_usi_load((stats.bytes - bytes) * 2 + xact->count,
+                 (SIM_CPU_HZ * 9ul) / (2 * bus_hz));
+
+    report_setpoints(xact->t_us, setpoints);
+    stats.transactions++;
+}
+
+int main(int argc, char** argv)
+{
+    static bustrace_xact_t xact;
+    unsigned long bus_hz = 100000;
+    double speed = 0, wall_start;
+    uint64_t t_last = 0;
+    servo_ctl_t setpoints;
+    // Grown as needed: a long burst with per-byte annotations has no bound
+    char* line = 0;
+    size_t line_cap = 0;
+    unsigned lineno = 0;
+    FILE* f;
+    int opt, ret;
+
+    while((opt = getopt(argc, argv, "s:b:v")) != -1)
+    {
+        switch(opt)
+        {
+        case 's':
+            speed = strtod(optarg, 0);
+            break;
+        case 'b':
+            bus_hz = strtoul(optarg, 0, 0);
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if(optind != argc - 1 || speed < 0 || !bus_hz)
+    {
+        fprintf(stderr, "usage: %s [-s speed] [-b bus_hz] [-v] trace\n",
+                argv[0]);
+        return 2;
+    }
+
+    if(!(f = fopen(argv[optind], "r")))
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    sim_init();
+    setpoints = *firmware_servos();
+    wall_start = now_us();
+
+    while(getline(&line, &line_cap, f) != -1)
+    {
+        lineno++;
+        if((ret = bustrace_parse(line, &xact)) == 0)
+            continue;
+        if(ret < 0)
+        {
+            fprintf(stderr, "%s:%u: %s\n", argv[optind], lineno,
+                    strerror(-ret));
+            return 1;
+        }
+        if(xact.t_us < t_last)
+        {
+            fprintf(stderr, "%s:%u: time goes backwards\n", argv[optind],
+                    lineno);
+            return 1;
+        }
+        t_last = xact.t_us;
+
+        sim_run_until(xact.t_us * (SIM_CPU_HZ / 1000000));
+
+        if(speed > 0)
+        {
+            double wait = wall_start + xact.t_us / speed - now_us();
+            if(wait > 0)
+                usleep(wait);
+        }
+
+        replay(&xact, bus_hz, &setpoints);
+    }
+    free(line);
+    fclose(f);
+
+    double wall_us = now_us() - wall_start;
+
+    printf("\n%lu transactions, %lu messages, %lu bytes over %.3f ms "
+           "(replayed in %.3f ms, %.0f transactions/s)\n",
+           stats.transactions, stats.messages, stats.bytes, t_last / 1000.0,
+           wall_us / 1000.0,
+           wall_us > 0 ? stats.transactions * 1e6 / wall_us : 0.0);
+    printf("%lu setpoint changes, %lu ACK/NACK differences, %lu read data "
+           "differences, %lu left busy after stop\n", stats.setpoint_changes,
+           stats.ack_mismatches, stats.data_mismatches, stats.stuck_busy);
+
+    printf("final setpoints: bands %u..%u\n", setpoints.baseband,
+           setpoints.maxband);
+    for(int i = 0; i < NUM_SERVOS; i++)
+        printf("  servo %d: pos %u, refresh_div %u\n", i, setpoints.pos[i],
+               setpoints.refresh_div[i]);
+
+    return (stats.ack_mismatches || stats.data_mismatches ||
+            stats.stuck_busy) ? 3 : 0;
+}
@@ -0,0 +1,801 @@
+/*
+ * servosim.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Runs the unmodified servo and ADC code against the peripheral model in sim.c
+ * and measures what comes out of the pins: per-channel pulse width error
+ * against the committed setpoint, interrupt latency of the rising and falling
+ * edges, frame period drift and jitter, and ADC conversions disturbed by a
+ * PWM edge during sampling. Setpoints come from a script and are sent through
+ * the master library, so they take the same path as on the bus.
+ *
+ * usage: servosim [-o out.vcd] [-w golden] [-g golden] [-t tolerance_ns]
+ *                 [-e max_error_ns] script
+ *
+ * Script lines (times in milliseconds, positions and bands in timer ticks):
+ *
+ *   duration <ms>
+ *   bus <hz>                       I2C clock, for the modelled USI load
+ *   cost <irq> <edge> <total>      handler cost in CPU cycles
+ *   at <ms> pos <channel> <ticks>
+ *   at <ms> bands <baseband> <maxband>
+ *   at <ms> refresh <channel> <div>
+ *   at <ms> adc <input> <value>
+ *   at <ms> read                   read the whole register map back
+ *
+ * Commands with the same time go out in one flush.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <msp430.h>
+
+#include "firmware.h"
+#include "servoctl.h"
+#include "simple_math.h"
+#include "sim.h"
+
+#define MAX_ACTIONS (1024)
+#define MAX_GOLDEN (256)
+
+#define HIST_BUCKETS (32)
+#define HIST_BUCKET_CYCLES (8)
+
+#define NS_PER_CYCLE (1e9 / SIM_CPU_HZ)
+/* VCD time unit is 100ps; a 16MHz cycle is 62.5ns */
+#define VCD_UNITS_PER_CYCLE (625)
+
+#define DEFAULT_MAX_ERROR_NS (4000)
+
+typedef enum
+{
+    ACT_POS,
+    ACT_BANDS,
+    ACT_REFRESH,
+    ACT_ADC,
+    ACT_READ
+} action_e;
+
+typedef struct
+{
+    uint64_t t;
+    action_e type;
+    long a, b;
+} action_t;
+
+typedef struct
+{
+    long min, max;
+    double sum;
+    unsigned long n;
+} stat_t;
+
+typedef struct
+{
+    unsigned long bucket[HIST_BUCKETS + 1];
+} hist_t;
+
+typedef struct
+{
+    uint8_t pin;
+    int timer, ccr;
+
+    bool high;
+    uint64_t rise;
+    uint64_t prev_rise;
+    uint32_t expected_width;
+    uint32_t next_width;
+
+    unsigned long pulses;
+    unsigned long mismatches;
+    unsigned long skipped_frames;
+    stat_t width_err;
+    stat_t period_err;
+    stat_t rise_lat, fall_lat;
+    hist_t rise_hist, fall_hist;
+} channel_t;
+
+static channel_t channels[NUM_SERVOS];
+
+static uint64_t last_equ[SIM_NUM_TIMERS][SIM_NUM_CCRS];
+static uint32_t tick_cycles;
+static long max_error;
+
+static unsigned long isr_count[SIM_NUM_IRQS];
+static uint64_t isr_cycles[SIM_NUM_IRQS];
+static uint64_t isr_start;
+
+static bool adc_sampling;
+static bool adc_noisy;
+static unsigned long adc_conversions;
+static unsigned long adc_noisy_conversions;
+
+static FILE* vcd;
+static bool vcd_started;
+static uint64_t vcd_time;
+static uint16_t vcd_levels;
+
+/* VCD identifiers */
+#define VCD_ID_PIN(i) ((char)('!' + (i)))
+#define VCD_ID_TIMER(c) ((char)('!' + 16 + (c)))
+#define VCD_ID_ISR(irq) ((char)('!' + 16 + SIM_NUM_CCRS + (irq)))
+#define VCD_ID_ADC ((char)('!' + 16 + SIM_NUM_CCRS + SIM_NUM_IRQS))
+
+static void stat_add(stat_t* s, long v)
+{
+    if(!s->n || v < s->min)
+        s->min = v;
+    if(!s->n || v > s->max)
+        s->max = v;
+    s->sum += v;
+    s->n++;
+}
+
+static double stat_mean(const stat_t* s)
+{
+    return s->n ? s->sum / s->n : 0;
+}
+
+static void hist_add(hist_t* h, long cycles)
+{
+    long b = cycles / HIST_BUCKET_CYCLES;
+
+    if(b < 0)
+        b = 0;
+    if(b > HIST_BUCKETS)
+        b = HIST_BUCKETS;
+    h->bucket[b]++;
+}
+
+static void vcd_change(uint64_t t, char id, bool level)
+{
+    if(!vcd)
+        return;
+
+    if(!vcd_started || t != vcd_time)
+    {
+        fprintf(vcd, "#%llu\n", (unsigned long long)t * VCD_UNITS_PER_CYCLE);
+        vcd_time = t;
+        vcd_started = true;
+    }
+    fprintf(vcd, "%d%c\n", level, id);
+}
+
+static void vcd_header(void)
+{
+    fprintf(vcd, "$timescale 100ps $end\n$scope module servo $end\n");
+    for(int i = 0; i < 16; i++)
+        fprintf(vcd, "$var wire 1 %c p%d_%d $end\n", VCD_ID_PIN(i),
+                1 + i / 8, i % 8);
+    for(int c = 0; c < SIM_NUM_CCRS; c++)
+        fprintf(vcd, "$var wire 1 %c ta0_out%d $end\n", VCD_ID_TIMER(c), c);
+    for(int irq = 0; irq < SIM_NUM_IRQS; irq++)
+        fprintf(vcd, "$var wire 1 %c isr_%s $end\n", VCD_ID_ISR(irq),
+                sim_irq_names[irq]);
+    fprintf(vcd, "$var wire 1 %c adc_sample $end\n", VCD_ID_ADC);
+    fprintf(vcd, "$upscope $end\n$enddefinitions $end\n");
+
+    fprintf(vcd, "$dumpvars\n");
+    for(int i = 0; i < 16; i++)
+        fprintf(vcd, "0%c\n", VCD_ID_PIN(i));
+    for(int c = 0; c < SIM_NUM_CCRS; c++)
+        fprintf(vcd, "0%c\n", VCD_ID_TIMER(c));
+    for(int irq = 0; irq < SIM_NUM_IRQS; irq++)
+        fprintf(vcd, "0%c\n", VCD_ID_ISR(irq));
+    fprintf(vcd, "0%c\n$end\n", VCD_ID_ADC);
+}
+
+/**
+ * @brief Gets the compare value the committed setpoint asks for, derived
+ * independently of servo.c.
+ */
+static uint16_t commanded_ticks(uint8_t servo)
+{
+    const servo_ctl_t* ctl = firmware_servos();
+    uint16_t range = sat_sub_u16(ctl->maxband, ctl->baseband);
+
+    return sat_add_u16(ctl->baseband, lesser(ctl->pos[servo], range));
+}
+
+static void channel_rise(channel_t* ch, uint64_t t)
+{
+    ch->high = true;
+    ch->rise = t;
+    ch->expected_width = ch->next_width;
+
+    /*
+     * Measure the period against the nearest whole number of frames, so
+     * refresh divisors (and the frame it takes for a new one to apply) don't
+     * show up as drift.
+     */
+    if(ch->prev_rise)
+    {
+        uint32_t frame = (uint32_t)firmware_pwm_period() * tick_cycles;
+        uint64_t interval = t - ch->prev_rise;
+        uint64_t frames = (interval + frame / 2) / frame;
+
+        if(!frames)
+            frames = 1;
+        ch->skipped_frames += frames - 1;
+        stat_add(&ch->period_err, (long)(interval - frames * frame));
+    }
+    ch->prev_rise = t;
+
+    stat_add(&ch->rise_lat, t - last_equ[0][0]);
+    hist_add(&ch->rise_hist, t - last_equ[0][0]);
+}
+
+static void channel_fall(channel_t* ch, uint64_t t)
+{
+    long err = (long)(t - ch->rise) - (long)ch->expected_width;
+
+    ch->high = false;
+    ch->pulses++;
+
+    stat_add(&ch->width_err, err);
+    if(labs(err) * NS_PER_CYCLE > max_error)
+        ch->mismatches++;
+
+    stat_add(&ch->fall_lat, t - last_equ[ch->timer][ch->ccr]);
+    hist_add(&ch->fall_hist, t - last_equ[ch->timer][ch->ccr]);
+}
+
+static void on_pins(uint64_t t, uint16_t levels)
+{
+    uint16_t changed = levels ^ vcd_levels;
+
+    for(int i = 0; i < 16; i++)
+        if(changed & (1u << i))
+            vcd_change(t, VCD_ID_PIN(i), levels & (1u << i));
+    vcd_levels = levels;
+
+    for(int i = 0; i < NUM_SERVOS; i++)
+    {
+        channel_t* ch = &channels[i];
+        bool level = firmware_servo_level(levels, i);
+
+        if(level == ch->high)
+            continue;
+
+        if(adc_sampling)
+            adc_noisy = true;
+
+        if(level)
+            channel_rise(ch, t);
+        else if(ch->rise)
+            channel_fall(ch, t);
+        else
+            ch->high = false;
+    }
+}
+
+static void on_timer_event(uint64_t t, int timer, int ccr, uint16_t value)
+{
+    (void)value;
+
+    last_equ[timer][ccr] = t;
+
+    /*
+     * The setpoint a pulse should have is whatever was committed when its slot
+     * started; a write landing while the slot ISR is pending can't be expected
+     * to make it in.
+     */
+    if(timer == 0 && ccr == 0)
+        for(int i = 0; i < NUM_SERVOS; i++)
+            channels[i].next_width = commanded_ticks(i) * tick_cycles;
+}
+
+static void on_timer_output(uint64_t t, int timer, int ccr, bool level)
+{
+    if(timer == 0)
+        vcd_change(t, VCD_ID_TIMER(ccr), level);
+}
+
+static void on_isr(uint64_t t, sim_irq_e irq, bool active)
+{
+    vcd_change(t, VCD_ID_ISR(irq), active);
+
+    if(active)
+    {
+        isr_count[irq]++;
+        isr_start = t;
+    }
+    else
+    {
+        isr_cycles[irq] += t - isr_start;
+    }
+}
+
+static void on_adc(uint64_t t, bool sampling, int inch)
+{
+    (void)inch;
+
+    vcd_change(t, VCD_ID_ADC, sampling);
+
+    if(sampling)
+    {
+        adc_noisy = false;
+    }
+    else
+    {
+        adc_conversions++;
+        if(adc_noisy)
+            adc_noisy_conversions++;
+    }
+    adc_sampling = sampling;
+}
+
+static int irq_by_name(const char* name)
+{
+    for(int irq = 0; irq < SIM_NUM_IRQS; irq++)
+        if(!strcmp(name, sim_irq_names[irq]))
+            return irq;
+    return -1;
+}
+
+static int compare_actions(const void* a, const void* b)
+{
+    const action_t* x = a;
+    const action_t* y = b;
+
+    if(x->t != y->t)
+        return (x->t < y->t) ? -1 : 1;
+    return (x < y) ? -1 : 1;
+}
+
+static int load_script(const char* path, action_t* actions, unsigned* count,
+                       uint64_t* duration, unsigned long* bus_hz)
+{
+    char line[256], cmd[32], name[32];
+    FILE* f = fopen(path, "r");
+    unsigned lineno = 0;
+    double ms;
+    long a, b;
+    int n;
+
+    if(!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    *count = 0;
+    while(fgets(line, sizeof(line), f))
+    {
+        char* hash = strchr(line, '#');
+        action_t* act = &actions[*count];
+
+        lineno++;
+        if(hash)
+            *hash = 0;
+        if(sscanf(line, "%31s", cmd) != 1)
+            continue;
+
+        if(!strcmp(cmd, "duration") && sscanf(line, "%*s %lf", &ms) == 1)
+        {
+            *duration = ms * (SIM_CPU_HZ / 1000);
+            continue;
+        }
+        if(!strcmp(cmd, "bus") && sscanf(line, "%*s %lu", bus_hz) == 1 &&
+           *bus_hz)
+            continue;
+        if(!strcmp(cmd, "cost") &&
+           sscanf(line, "%*s %31s %ld %ld", name, &a, &b) == 3 &&
+           irq_by_name(name) >= 0 && a >= 0 && b > a)
+        {
+            sim_cost[irq_by_name(name)].edge = a;
+            sim_cost[irq_by_name(name)].total = b;
+            continue;
+        }
+
+        if(strcmp(cmd, "at") || *count == MAX_ACTIONS ||
+           (n = sscanf(line, "%*s %lf %31s %ld %ld", &ms, name, &a, &b)) < 2 ||
+           ms < 0)
+            goto bad;
+
+        act->t = ms * (SIM_CPU_HZ / 1000);
+        act->a = a;
+        act->b = b;
+
+        if(!strcmp(name, "pos") && n == 4 && a >= 0 && a < NUM_SERVOS)
+            act->type = ACT_POS;
+        else if(!strcmp(name, "bands") && n == 4)
+            act->type = ACT_BANDS;
+        else if(!strcmp(name, "refresh") && n == 4 && a >= 0 &&
+                a < NUM_SERVOS && b >= 0 && b < 256)
+            act->type = ACT_REFRESH;
+        else if(!strcmp(name, "adc") && n == 4 && a >= 0 &&
+                a < SIM_NUM_ADC_INPUTS)
+            act->type = ACT_ADC;
+        else if(!strcmp(name, "read") && n == 2)
+            act->type = ACT_READ;
+        else
+            goto bad;
+
+        (*count)++;
+        continue;
+
+bad:
+        fprintf(stderr, "%s:%u: bad line\n", path, lineno);
+        fclose(f);
+        return -1;
+    }
+
+    fclose(f);
+    qsort(actions, *count, sizeof(actions[0]), compare_actions);
+    return 0;
+}
+
+/**
+ * @brief Sends one time step's worth of script commands. The bytes reach the
+ * firmware directly; their interrupt load is queued on the modelled USI.
+ */
+static int apply_actions(servoctl_t* dev, const action_t* acts, unsigned count,
+                         unsigned long bus_hz)
+{
+    servoctl_stats_t before = dev->stats;
+    bool staged = false;
+    memmap_t map;
+    int ret = 0;
+
+    for(unsigned i = 0; i < count && !ret; i++)
+    {
+        const action_t* act = &acts[i];
+
+        switch(act->type)
+        {
+        case ACT_POS:
+            ret = servoctl_set_pos(dev, act->a, act->b);
+            staged = true;
+            break;
+        case ACT_BANDS:
+            ret = servoctl_set_bands(dev, act->a, act->b);
+            staged = true;
+            break;
+        case ACT_REFRESH:
+            ret = servoctl_set_refresh(dev, act->a, act->b);
+            staged = true;
+            break;
+        case ACT_ADC:
+            sim_set_analog(act->a, act->b);
+            break;
+        case ACT_READ:
+            ret = servoctl_read(dev, &map);
+            break;
+        }
+    }
+
+    if(staged && !ret)
+        ret = servoctl_flush(dev);
+
+    sim_after_firmware();
+
+    /* Two interrupts per byte (data and acknowledge) plus one per start */
+    unsigned long bytes = dev->stats.bytes - before.bytes;
+    unsigned long msgs = dev->stats.messages - before.messages;
+    sim_usi_load(bytes * 2 + msgs, (SIM_CPU_HZ * 9ul) / (2 * bus_hz));
+
+    return ret;
+}
+
+typedef struct
+{
+    char key[48];
+    double value;
+} metric_t;
+
+static metric_t metrics[MAX_GOLDEN];
+static unsigned num_metrics;
+
+static void metric(const char* key, double value)
+{
+    if(num_metrics == MAX_GOLDEN)
+        return;
+    snprintf(metrics[num_metrics].key, sizeof(metrics[0].key), "%s", key);
+    metrics[num_metrics].value = value;
+    num_metrics++;
+}
+
+static void collect_metrics(void)
+{
+    char key[48];
+
+    for(int i = 0; i < NUM_SERVOS; i++)
+    {
+        const channel_t* ch = &channels[i];
+
+#define CH_METRIC(name, v) \
+        snprintf(key, sizeof(key), "ch%d.%s", i, name), metric(key, v)
+
+        CH_METRIC("pulses", ch->pulses);
+        CH_METRIC("mismatches", ch->mismatches);
+        CH_METRIC("skipped_frames", ch->skipped_frames);
+        CH_METRIC("width_err_min_ns", ch->width_err.min * NS_PER_CYCLE);
+        CH_METRIC("width_err_max_ns", ch->width_err.max * NS_PER_CYCLE);
+        CH_METRIC("width_err_mean_ns", stat_mean(&ch->width_err) * NS_PER_CYCLE);
+        CH_METRIC("rise_lat_min_ns", ch->rise_lat.min * NS_PER_CYCLE);
+        CH_METRIC("rise_lat_max_ns", ch->rise_lat.max * NS_PER_CYCLE);
+        CH_METRIC("fall_lat_min_ns", ch->fall_lat.min * NS_PER_CYCLE);
+        CH_METRIC("fall_lat_max_ns", ch->fall_lat.max * NS_PER_CYCLE);
+        CH_METRIC("period_err_min_ns", ch->period_err.min * NS_PER_CYCLE);
+        CH_METRIC("period_err_max_ns", ch->period_err.max * NS_PER_CYCLE);
+        CH_METRIC("period_drift_ns", stat_mean(&ch->period_err) * NS_PER_CYCLE);
+
+#undef CH_METRIC
+    }
+
+    metric("adc.conversions", adc_conversions);
+    metric("adc.noisy", adc_noisy_conversions);
+}
+
+static void print_hist(const char* name, const hist_t* h)
+{
+    unsigned long most = 0;
+
+    for(int b = 0; b <= HIST_BUCKETS; b++)
+        if(h->bucket[b] > most)
+            most = h->bucket[b];
+
+    printf("  %s latency:\n", name);
+    for(int b = 0; b <= HIST_BUCKETS; b++)
+    {
+        if(!h->bucket[b])
+            continue;
+        printf("    %s%6.0f ns %8lu ", (b == HIST_BUCKETS) ? ">=" : "  ",
+               b * HIST_BUCKET_CYCLES * NS_PER_CYCLE, h->bucket[b]);
+        for(unsigned long n = 0; n < (h->bucket[b] * 40 + most - 1) / most; n++)
+            putchar('#');
+        putchar('\n');
+    }
+}
+
+static void report(uint64_t duration)
+{
+    for(int i = 0; i < NUM_SERVOS; i++)
+    {
+        const channel_t* ch = &channels[i];
+
+        printf("channel %d (P%d.%d): %lu pulses, %lu off by more than %ld ns\n",
+               i, 1 + ch->pin / 8, ch->pin % 8, ch->pulses, ch->mismatches,
+               max_error);
+        printf("  width error   min %8.1f max %8.1f mean %8.1f ns\n",
+               ch->width_err.min * NS_PER_CYCLE,
+               ch->width_err.max * NS_PER_CYCLE,
+               stat_mean(&ch->width_err) * NS_PER_CYCLE);
+        printf("  %lu frame(s) skipped by the refresh divisor\n",
+               ch->skipped_frames);
+        printf("  period error  min %8.1f max %8.1f mean %8.1f ns "
+               "(jitter %.1f ns p-p)\n",
+               ch->period_err.min * NS_PER_CYCLE,
+               ch->period_err.max * NS_PER_CYCLE,
+               stat_mean(&ch->period_err) * NS_PER_CYCLE,
+               (ch->period_err.max - ch->period_err.min) * NS_PER_CYCLE);
+        print_hist("rise", &ch->rise_hist);
+        print_hist("fall", &ch->fall_hist);
+    }
+
+    printf("adc10: %lu conversions, %lu with a PWM edge while sampling\n",
+           adc_conversions, adc_noisy_conversions);
+
+    printf("interrupts:\n");
+    for(int irq = SIM_NUM_IRQS - 1; irq >= 0; irq--)
+        if(isr_count[irq])
+            printf("  %-8s %8lu calls %6.2f%% cpu\n", sim_irq_names[irq],
+                   isr_count[irq], 100.0 * isr_cycles[irq] / duration);
+}
+
+static int write_golden(const char* path)
+{
+    FILE* f = fopen(path, "w");
+
+    if(!f)
+    {
+        perror(path);
+        return -1;
+    }
+    for(unsigned i = 0; i < num_metrics; i++)
+        fprintf(f, "%s %.1f\n", metrics[i].key, metrics[i].value);
+    fclose(f);
+    return 0;
+}
+
+/**
+ * @brief Compares the metrics against a golden file. Times (keys ending in
+ * _ns) may differ by the tolerance; counts must match.
+ *
+ * @return The number of differences, or -1 if the file can't be read.
+ */
+static int check_golden(const char* path, double tolerance)
+{
+    FILE* f = fopen(path, "r");
+    char key[48];
+    double value;
+    int failures = 0;
+
+    if(!f)
+    {
+        perror(path);
+        return -1;
+    }
+
+    while(fscanf(f, "%47s %lf", key, &value) == 2)
+    {
+        unsigned i;
+        size_t len = strlen(key);
+        double tol = (len > 3 && !strcmp(key + len - 3, "_ns")) ? tolerance : 0;
+
+        for(i = 0; i < num_metrics; i++)
+            if(!strcmp(metrics[i].key, key))
+                break;
+
+        if(i == num_metrics)
+        {
+            printf("golden: %s missing\n", key);
+            failures++;
+        }
+        else if(metrics[i].value - value > tol + 0.05 ||
+                value - metrics[i].value > tol + 0.05)
+        {
+            printf("golden: %s is %.1f, expected %.1f\n", key,
+                   metrics[i].value, value);
+            failures++;
+        }
+    }
+
+    fclose(f);
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    static action_t actions[MAX_ACTIONS];
+    const char *vcd_path = 0, *golden = 0, *new_golden = 0;
+    uint64_t duration = SIM_CPU_HZ / 10;
+    unsigned long bus_hz = 100000;
+    double tolerance = 0;
+    unsigned count, i;
+    servoctl_bus_t bus;
+    servoctl_t dev;
+    int opt, ret;
+
+    max_error = DEFAULT_MAX_ERROR_NS;
+
+    while((opt = getopt(argc, argv, "o:g:w:t:e:")) != -1)
+    {
+        switch(opt)
+        {
+        case 'o':
+            vcd_path = optarg;
+            break;
+        case 'g':
+            golden = optarg;
+            break;
+        case 'w':
+            new_golden = optarg;
+            break;
+        case 't':
+            tolerance = strtod(optarg, 0);
+            break;
+        case 'e':
+            max_error = strtol(optarg, 0, 0);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+
+    if(optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-o out.vcd] [-w golden] [-g golden] "
+                "[-t tolerance_ns] [-e max_error_ns] script\n", argv[0]);
+        return 2;
+    }
+
+    if(load_script(argv[optind], actions, &count, &duration, &bus_hz))
+        return 2;
+
+    if(vcd_path)
+    {
+        vcd = fopen(vcd_path, "w");
+        if(!vcd)
+        {
+            perror(vcd_path);
+            return 1;
+        }
+        vcd_header();
+    }
+
+    for(int c = 0; c < NUM_SERVOS; c++)
+    {
+        channels[c].pin = firmware_pwm_pin(c);
+        firmware_servo_unit(c, &channels[c].timer, &channels[c].ccr);
+    }
+
+    sim_observer.pins = on_pins;
+    sim_observer.timer_event = on_timer_event;
+    sim_observer.timer_output = on_timer_output;
+    sim_observer.isr = on_isr;
+    sim_observer.adc = on_adc;
+
+    sim_init();
+    tick_cycles = sim_timer_tick_cycles(0);
+
+    ret = servoctl_bus_fake(&bus);
+    if(!ret)
+        ret = servoctl_open(&dev, bus, I2C_SLAVE_ADDR);
+    if(ret)
+    {
+        fprintf(stderr, "open: %s\n", strerror(-ret));
+        return 1;
+    }
+
+    for(i = 0; i < count; )
+    {
+        unsigned n = 1;
+
+        while(i + n < count && actions[i + n].t == actions[i].t)
+            n++;
+        if(actions[i].t >= duration)
+            break;
+
+        sim_run_until(actions[i].t);
+        ret = apply_actions(&dev, &actions[i], n, bus_hz);
+        if(ret)
+        {
+            fprintf(stderr, "at %.3f ms: %s\n",
+                    actions[i].t / (SIM_CPU_HZ / 1000.0), strerror(-ret));
+            return 1;
+        }
+        i += n;
+    }
+    sim_run_until(duration);
+
+    servoctl_close(&dev);
+    if(vcd)
+    {
+        fprintf(vcd, "#%llu\n",
+                (unsigned long long)duration * VCD_UNITS_PER_CYCLE);
+        fclose(vcd);
+    }
+
+    report(duration);
+    collect_metrics();
+
+    if(new_golden && write_golden(new_golden))
+        return 1;
+    if(golden)
+    {
+        int failures = check_golden(golden, tolerance);
+        if(failures)
+        {
+            printf("golden: %d difference(s)\n", failures < 0 ? 1 : failures);
+            return 1;
+        }
+        printf("golden: match\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,668 @@
+/*
+ * sim.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Time advances from event to event in CPU cycles: timer clock ticks, the end
+ * of an interrupt handler, port writes becoming visible, ADC10 sample and
+ * conversion phases, and the modelled USI interrupt train. Interrupts are taken
+ * when the CPU is idle and GIE is set, highest priority first, and never nest
+ * (every handler in the firmware runs with GIE clear).
+ *
+ * Register writes made by a handler are applied to the model as soon as the
+ * handler returns on the host, except for port outputs, which are held back
+ * until the handler's edge offset has elapsed.
+ */
+
+#include "sim.h"
+
+#include <string.h>
+
+#include <msp430.h>
+
+#include "fakedev.h"
+#include "firmware.h"
+
+/* How often the main loop gets to run memmap_service() while the CPU is idle */
+#define SIM_SERVICE_INTERVAL (256)
+
+/* ADC10OSC is about 5MHz */
+#define SIM_ADC10OSC_CYCLES (3)
+#define SIM_ACLK_CYCLES (SIM_CPU_HZ / 32768)
+
+#define SIM_ADC_CONVERT_CLOCKS (13)
+
+/* Defaults are estimates from the generated code at -Os */
+sim_cost_t sim_cost[SIM_NUM_IRQS] =
+{
+    [SIM_IRQ_USI]    = { 40, 90 },
+    [SIM_IRQ_ADC10]  = { 40, 70 },
+    [SIM_IRQ_TA0_A1] = { 24, 70 },
+    [SIM_IRQ_TA0_A0] = { 36, 110 },
+    [SIM_IRQ_TA1_A1] = { 24, 70 },
+    [SIM_IRQ_TA1_A0] = { 36, 110 },
+};
+
+sim_observer_t sim_observer;
+
+const char* const sim_irq_names[SIM_NUM_IRQS] =
+{
+    "usi", "adc10", "ta0_a1", "ta0_a0", "ta1_a1", "ta1_a0"
+};
+
+typedef struct
+{
+    volatile uint16_t* ctl;
+    volatile uint16_t* r;
+    volatile uint16_t* iv;
+    volatile uint16_t* cctl[SIM_NUM_CCRS];
+    volatile uint16_t* ccr[SIM_NUM_CCRS];
+} sim_timer_regs_t;
+
+static const sim_timer_regs_t timer_regs[SIM_NUM_TIMERS] =
+{
+    { &TA0CTL, &TA0R, &TA0IV, { &TA0CCTL0, &TA0CCTL1, &TA0CCTL2 },
+      { &TA0CCR0, &TA0CCR1, &TA0CCR2 } },
+    { &TA1CTL, &TA1R, &TA1IV, { &TA1CCTL0, &TA1CCTL1, &TA1CCTL2 },
+      { &TA1CCR0, &TA1CCR1, &TA1CCR2 } },
+};
+
+/* Pins that carry a timer output when selected (MSP430G2x53 superset) */
+typedef struct
+{
+    uint8_t pin;
+    uint8_t timer;
+    uint8_t ccr;
+} sim_timer_pin_t;
+
+static const sim_timer_pin_t timer_pins[] =
+{
+    { 1, 0, 0 }, { 2, 0, 1 }, { 5, 0, 0 }, { 6, 0, 1 },
+    { 8, 1, 0 }, { 9, 1, 1 }, { 10, 1, 1 }, { 11, 1, 0 }, { 12, 1, 2 },
+    { 13, 1, 2 },
+};
+
+typedef struct
+{
+    bool running;
+    bool down;
+    uint64_t next_tick;
+    bool out[SIM_NUM_CCRS];
+} sim_timer_t;
+
+static uint64_t now;
+
+static sim_timer_t timers[SIM_NUM_TIMERS];
+
+/* CPU */
+static bool cpu_busy;
+static sim_irq_e cpu_irq;
+static uint64_t cpu_done;
+static uint64_t next_service;
+
+/* Port outputs as seen on the pins, and a handler's writes still in flight */
+static uint8_t visible_out[2];
+static bool out_pending;
+static uint64_t out_commit;
+static uint16_t last_levels;
+
+/* ADC10 */
+static uint16_t analog[SIM_NUM_ADC_INPUTS];
+static bool adc_busy;
+static bool adc_sampling;
+static int adc_inch;
+static uint64_t adc_sample_end, adc_done;
+
+/* Modelled USI interrupt train */
+static unsigned usi_remaining;
+static unsigned usi_pending;
+static uint32_t usi_spacing;
+static uint64_t usi_next;
+
+uint64_t sim_now(void)
+{
+    return now;
+}
+
+static uint32_t smclk_cycles(void)
+{
+    return 1u << ((BCSCTL2 & DIVS_3) >> 1);
+}
+
+/**
+ * @brief Gets the length of a timer clock tick. Only SMCLK is modelled as a
+ * timer clock source.
+ */
+uint32_t sim_timer_tick_cycles(int timer)
+{
+    uint16_t ctl = *timer_regs[timer].ctl;
+
+    return smclk_cycles() << ((ctl & ID_3) >> 6);
+}
+
+bool sim_timer_output(int timer, int ccr)
+{
+    return timers[timer].out[ccr];
+}
+
+uint16_t sim_pin_levels(void)
+{
+    uint16_t dir = P1DIR | (P2DIR << 8);
+    uint16_t sel = P1SEL | (P2SEL << 8);
+    uint16_t levels = (visible_out[0] | (visible_out[1] << 8)) & ~sel;
+
+    for(unsigned i = 0; i < sizeof(timer_pins) / sizeof(timer_pins[0]); i++)
+    {
+        const sim_timer_pin_t* tp = &timer_pins[i];
+        if((sel & (1u << tp->pin)) && timers[tp->timer].out[tp->ccr])
+            levels |= 1u << tp->pin;
+    }
+
+    return levels & dir;
+}
+
+static void update_pins(void)
+{
+    uint16_t levels = sim_pin_levels();
+
+    if(levels != last_levels)
+    {
+        last_levels = levels;
+        if(sim_observer.pins)
+            sim_observer.pins(now, levels);
+    }
+}
+
+static void adc_start(void)
+{
+    static const uint8_t sht_clocks[] = { 4, 8, 16, 64 };
+    uint32_t clk;
+
+    switch(ADC10CTL1 & ADC10SSEL_3)
+    {
+    case ADC10SSEL_0: clk = SIM_ADC10OSC_CYCLES; break;
+    case ADC10SSEL_1: clk = SIM_ACLK_CYCLES; break;
+    case ADC10SSEL_2: clk = 1; break;
+    default: clk = smclk_cycles(); break;
+    }
+    clk *= ((ADC10CTL1 >> 5) & 7) + 1;
+
+    adc_inch = ADC10CTL1 >> 12;
+    adc_busy = true;
+    adc_sampling = true;
+    adc_sample_end = now + clk * sht_clocks[(ADC10CTL0 >> 11) & 3];
+    adc_done = adc_sample_end + clk * SIM_ADC_CONVERT_CLOCKS;
+    ADC10CTL1 |= ADC10BUSY;
+
+    if(sim_observer.adc)
+        sim_observer.adc(now, true, adc_inch);
+}
+
+static bool adc_armed(void)
+{
+    return !adc_busy && (ADC10CTL0 & ADC10ON) && (ADC10CTL0 & ENC);
+}
+
+/**
+ * @brief Starts a conversion from a rising edge on a TA0 output, if the ADC10
+ * is waiting for that output.
+ */
+static void adc_timer_trigger(int timer, int ccr)
+{
+    /* SHS_1 = TA0.1, SHS_2 = TA0.0, SHS_3 = TA0.2 */
+    static const uint16_t sources[SIM_NUM_CCRS] = { SHS_2, SHS_1, SHS_3 };
+
+    if(timer == 0 && adc_armed() && (ADC10CTL1 & SHS_3) == sources[ccr])
+        adc_start();
+}
+
+static void adc_complete(void)
+{
+    adc_busy = false;
+    ADC10CTL1 &= ~ADC10BUSY;
+    ADC10MEM = analog[adc_inch] & 0x3FF;
+    ADC10CTL0 |= ADC10IFG;
+
+    // Repeat modes with MSC set start the next conversion immediately
+    if((ADC10CTL1 & CONSEQ_2) && (ADC10CTL0 & MSC) && adc_armed())
+        adc_start();
+}
+
+static void timer_set_output(int timer, int ccr, bool level)
+{
+    bool prev = timers[timer].out[ccr];
+
+    if(level == prev)
+        return;
+
+    timers[timer].out[ccr] = level;
+    if(sim_observer.timer_output)
+        sim_observer.timer_output(now, timer, ccr, level);
+    if(level)
+        adc_timer_trigger(timer, ccr);
+}
+
+/**
+ * @brief Applies an output unit's mode to an EQUx and/or EQU0 event.
+ */
+static void timer_output_event(int timer, int ccr, bool equx, bool equ0)
+{
+    bool out = timers[timer].out[ccr];
+
+    switch(*timer_regs[timer].cctl[ccr] & OUTMOD_7)
+    {
+    case OUTMOD_1:
+        if(equx) out = true;
+        break;
+    case OUTMOD_2:
+        if(equx) out = !out;
+        if(equ0) out = false;
+        break;
+    case OUTMOD_3:
+        if(equx) out = true;
+        if(equ0) out = false;
+        break;
+    case OUTMOD_4:
+        if(equx) out = !out;
+        break;
+    case OUTMOD_5:
+        if(equx) out = false;
+        break;
+    case OUTMOD_6:
+        if(equx) out = !out;
+        if(equ0) out = true;
+        break;
+    case OUTMOD_7:
+        if(equx) out = false;
+        if(equ0) out = true;
+        break;
+    default:
+        return;
+    }
+
+    timer_set_output(timer, ccr, out);
+}
+
+static void timer_tick(int timer)
+{
+    const sim_timer_regs_t* regs = &timer_regs[timer];
+    sim_timer_t* tm = &timers[timer];
+    uint16_t r = *regs->r;
+    uint16_t ccr0 = *regs->ccr[0];
+    bool equ[SIM_NUM_CCRS];
+
+    switch(*regs->ctl & MC_3)
+    {
+    case MC_1:
+        // Lowering CCR0 below the count also rolls the timer over
+        if(r >= ccr0)
+        {
+            r = 0;
+            *regs->ctl |= TAIFG;
+        }
+        else
+        {
+            r++;
+        }
+        break;
+
+    case MC_2:
+        if(++r == 0)
+            *regs->ctl |= TAIFG;
+        break;
+
+    case MC_3:
+        if(tm->down)
+        {
+            if(--r == 0)
+            {
+                tm->down = false;
+                *regs->ctl |= TAIFG;
+            }
+        }
+        else if(++r >= ccr0)
+        {
+            r = ccr0;
+            tm->down = true;
+        }
+        break;
+    }
+
+    *regs->r = r;
+
+    for(int c = 0; c < SIM_NUM_CCRS; c++)
+    {
+        equ[c] = !(*regs->cctl[c] & CAP) && r == *regs->ccr[c];
+        if(equ[c])
+        {
+            *regs->cctl[c] |= CCIFG;
+            if(sim_observer.timer_event)
+                sim_observer.timer_event(now, timer, c, r);
+        }
+    }
+
+    for(int c = 0; c < SIM_NUM_CCRS; c++)
+        timer_output_event(timer, c, equ[c], equ[0]);
+}
+
+/**
+ * @brief Brings the model in line with register writes made by the firmware
+ * (or the harness) outside of interrupt handlers.
+ */
+static void sync_registers(void)
+{
+    for(int t = 0; t < SIM_NUM_TIMERS; t++)
+    {
+        const sim_timer_regs_t* regs = &timer_regs[t];
+        sim_timer_t* tm = &timers[t];
+        bool running = (*regs->ctl & MC_3) != MC_0;
+
+        if(*regs->ctl & TACLR)
+        {
+            *regs->ctl &= ~TACLR;
+            *regs->r = 0;
+            tm->down = false;
+            if(tm->running)
+                tm->next_tick = now + sim_timer_tick_cycles(t);
+        }
+
+        if(running && !tm->running)
+            tm->next_tick = now + sim_timer_tick_cycles(t);
+        tm->running = running;
+
+        // In output mode 0 the output follows the OUT bit
+        for(int c = 0; c < SIM_NUM_CCRS; c++)
+            if(!(*regs->cctl[c] & OUTMOD_7))
+                timer_set_output(t, c, *regs->cctl[c] & OUT);
+    }
+
+    if(adc_armed() && (ADC10CTL1 & SHS_3) == SHS_0 && (ADC10CTL0 & ADC10SC))
+    {
+        ADC10CTL0 &= ~ADC10SC;
+        adc_start();
+    }
+}
+
+void sim_after_firmware(void)
+{
+    sync_registers();
+
+    if(!out_pending)
+    {
+        visible_out[0] = P1OUT;
+        visible_out[1] = P2OUT;
+    }
+    update_pins();
+}
+
+static bool irq_pending(sim_irq_e irq)
+{
+    const sim_timer_regs_t* regs;
+
+    switch(irq)
+    {
+    case SIM_IRQ_USI:
+        return usi_pending;
+
+    case SIM_IRQ_ADC10:
+        return (ADC10CTL0 & ADC10IE) && (ADC10CTL0 & ADC10IFG);
+
+    case SIM_IRQ_TA0_A0:
+    case SIM_IRQ_TA1_A0:
+        regs = &timer_regs[irq == SIM_IRQ_TA1_A0];
+        return (*regs->cctl[0] & (CCIE | CCIFG)) == (CCIE | CCIFG);
+
+    case SIM_IRQ_TA0_A1:
+    case SIM_IRQ_TA1_A1:
+        regs = &timer_regs[irq == SIM_IRQ_TA1_A1];
+        return (*regs->cctl[1] & (CCIE | CCIFG)) == (CCIE | CCIFG) ||
+               (*regs->cctl[2] & (CCIE | CCIFG)) == (CCIE | CCIFG) ||
+               (*regs->ctl & (TAIE | TAIFG)) == (TAIE | TAIFG);
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Latches the highest pending source into TAxIV and clears its flag,
+ * as the first read of TAxIV does on the part.
+ */
+static void timer_latch_iv(int timer)
+{
+    const sim_timer_regs_t* regs = &timer_regs[timer];
+
+    if((*regs->cctl[1] & (CCIE | CCIFG)) == (CCIE | CCIFG))
+    {
+        *regs->cctl[1] &= ~CCIFG;
+        *regs->iv = 0x02;
+    }
+    else if((*regs->cctl[2] & (CCIE | CCIFG)) == (CCIE | CCIFG))
+    {
+        *regs->cctl[2] &= ~CCIFG;
+        *regs->iv = 0x04;
+    }
+    else
+    {
+        *regs->ctl &= ~TAIFG;
+        *regs->iv = 0x0A;
+    }
+}
+
+static void run_handler(sim_irq_e irq)
+{
+    switch(irq)
+    {
+    case SIM_IRQ_USI:
+        // The bytes themselves were delivered by the fake bus
+        usi_pending--;
+        break;
+    case SIM_IRQ_ADC10:
+        firmware_adc10();
+        break;
+    case SIM_IRQ_TA0_A0:
+        TA0CCTL0 &= ~CCIFG;
+        firmware_timer0_a0();
+        break;
+    case SIM_IRQ_TA0_A1:
+        timer_latch_iv(0);
+        firmware_timer0_a1();
+        break;
+    case SIM_IRQ_TA1_A0:
+        // The firmware has no TA1 CCR0 handler; just acknowledge
+        TA1CCTL0 &= ~CCIFG;
+        break;
+    case SIM_IRQ_TA1_A1:
+        timer_latch_iv(1);
+        firmware_timer1_a1();
+        break;
+    default:
+        break;
+    }
+}
+
+static void take_interrupt(sim_irq_e irq)
+{
+    cpu_busy = true;
+    cpu_irq = irq;
+    cpu_done = now + sim_cost[irq].total;
+
+    if(sim_observer.isr)
+        sim_observer.isr(now, irq, true);
+
+    // The CPU clears GIE on entry and RETI restores it
+    host_sr &= ~GIE;
+    run_handler(irq);
+    host_sr |= GIE;
+
+    sync_registers();
+
+    out_pending = true;
+    out_commit = now + sim_cost[irq].edge;
+}
+
+static void dispatch(void)
+{
+    if(cpu_busy || !(host_sr & GIE))
+        return;
+
+    for(int irq = SIM_NUM_IRQS - 1; irq >= 0; irq--)
+    {
+        if(irq_pending(irq))
+        {
+            take_interrupt(irq);
+            return;
+        }
+    }
+}
+
+static uint64_t earliest(uint64_t a, uint64_t b)
+{
+    return (a < b) ? a : b;
+}
+
+void sim_run_until(uint64_t t)
+{
+    while(now < t)
+    {
+        uint64_t next = t;
+
+        if(out_pending && now >= out_commit)
+        {
+            out_pending = false;
+            visible_out[0] = P1OUT;
+            visible_out[1] = P2OUT;
+            update_pins();
+        }
+
+        if(cpu_busy && now >= cpu_done)
+        {
+            cpu_busy = false;
+            if(sim_observer.isr)
+                sim_observer.isr(now, cpu_irq, false);
+        }
+
+        for(int i = 0; i < SIM_NUM_TIMERS; i++)
+        {
+            if(timers[i].running && now >= timers[i].next_tick)
+            {
+                timers[i].next_tick += sim_timer_tick_cycles(i);
+                timer_tick(i);
+            }
+        }
+
+        if(adc_sampling && now >= adc_sample_end)
+        {
+            adc_sampling = false;
+            if(sim_observer.adc)
+                sim_observer.adc(now, false, adc_inch);
+        }
+        if(adc_busy && now >= adc_done)
+            adc_complete();
+
+        if(usi_remaining && now >= usi_next)
+        {
+            usi_remaining--;
+            usi_pending++;
+            usi_next += usi_spacing;
+        }
+
+        update_pins();
+        dispatch();
+
+        if(!cpu_busy && now >= next_service)
+        {
+            firmware_service();
+            sim_after_firmware();
+            next_service = now + SIM_SERVICE_INTERVAL;
+        }
+
+        if(out_pending)
+            next = earliest(next, out_commit);
+        if(cpu_busy)
+            next = earliest(next, cpu_done);
+        else
+            next = earliest(next, next_service);
+        for(int i = 0; i < SIM_NUM_TIMERS; i++)
+            if(timers[i].running)
+                next = earliest(next, timers[i].next_tick);
+        if(adc_sampling)
+            next = earliest(next, adc_sample_end);
+        if(adc_busy)
+            next = earliest(next, adc_done);
+        if(usi_remaining)
+            next = earliest(next, usi_next);
+
+        now = (next > now) ? next : now + 1;
+    }
+}
+
+/**
+ * @brief Sets the level an analog input converts to.
+ */
+void sim_set_analog(int inch, uint16_t value)
+{
+    analog[inch & (SIM_NUM_ADC_INPUTS - 1)] = value;
+}
+
+/**
+ * @brief Queues USI interrupts, one every spacing cycles from now, to stand in
+ * for the handler load of an I2C transaction.
+ */
+void sim_usi_load(unsigned interrupts, uint32_t spacing)
+{
+    if(!usi_remaining)
+        usi_next = now;
+    usi_remaining += interrupts;
+    usi_spacing = spacing ? spacing : 1;
+}
+
+/**
+ * @brief Resets the model and boots the firmware. The clock setup from main()
+ * is done here, since main() itself never returns.
+ */
+void sim_init(void)
+{
+    now = 0;
+    memset(timers, 0, sizeof(timers));
+    cpu_busy = false;
+    next_service = 0;
+    out_pending = false;
+    adc_busy = false;
+    adc_sampling = false;
+    usi_remaining = 0;
+    usi_pending = 0;
+
+    BCSCTL2 = DIVS_3;
+    P1OUT = 0;
+    P1DIR = 0;
+    P2OUT = 0;
+    P2DIR = 0;
+
+    fakedev_init();
+    sim_after_firmware();
+
+    P1DIR |= 0x01;
+    host_sr |= GIE;
+
+    last_levels = sim_pin_levels();
+    if(sim_observer.pins)
+        sim_observer.pins(now, last_levels);
+}
@@ -0,0 +1,94 @@
+/*
+ * sim.h
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Cycle-stepped model of the peripherals the servo and ADC code drive:
+ * Timer_A (TA0, and TA1 where the part has it), the port outputs and the
+ * ADC10, plus the interrupt controller. The firmware's handlers run as host
+ * functions; each interrupt occupies the CPU for a configurable number of
+ * cycles and its port writes take effect a configurable number of cycles after
+ * the handler is entered, which is where interrupt latency and preemption show
+ * up in the output timing.
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIM_CPU_HZ (16000000ul)
+
+#define SIM_NUM_TIMERS (2)
+#define SIM_NUM_CCRS (3)
+#define SIM_NUM_ADC_INPUTS (16)
+
+/* In ascending priority, as in the MSP430x2xx vector table */
+typedef enum
+{
+    SIM_IRQ_USI = 0,
+    SIM_IRQ_ADC10,
+    SIM_IRQ_TA0_A1,
+    SIM_IRQ_TA0_A0,
+    SIM_IRQ_TA1_A1,
+    SIM_IRQ_TA1_A0,
+    SIM_NUM_IRQS
+} sim_irq_e;
+
+typedef struct
+{
+    /* Cycles from the interrupt request being taken to the handler's port write */
+    uint32_t edge;
+    /* Cycles the handler occupies the CPU, including entry and return */
+    uint32_t total;
+} sim_cost_t;
+
+/*
+ * Hooks for whoever is watching the simulation. Any of them may be null.
+ * Port levels are P1 in the low byte and P2 in the high byte.
+ */
+typedef struct
+{
+    void (*pins)(uint64_t t, uint16_t levels);
+    void (*timer_event)(uint64_t t, int timer, int ccr, uint16_t value);
+    void (*timer_output)(uint64_t t, int timer, int ccr, bool level);
+    void (*isr)(uint64_t t, sim_irq_e irq, bool active);
+    void (*adc)(uint64_t t, bool sampling, int inch);
+} sim_observer_t;
+
+extern sim_cost_t sim_cost[SIM_NUM_IRQS];
+extern sim_observer_t sim_observer;
+
+extern const char* const sim_irq_names[SIM_NUM_IRQS];
+
+void sim_init(void);
+void sim_run_until(uint64_t t);
+void sim_after_firmware(void);
+uint64_t sim_now(void);
+
+uint32_t sim_timer_tick_cycles(int timer);
+uint16_t sim_pin_levels(void);
+bool sim_timer_output(int timer, int ccr);
+
+void sim_set_analog(int inch, uint16_t value);
+void sim_usi_load(unsigned interrupts, uint32_t spacing);
+
+#endif // SIM_H
@@ -0,0 +1,264 @@
+/*
+ * test_attention.c
+ *
+ * Copyright (C) 2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *
+ *
+ * Checks the attention line through the fake device, built with
+ * ATTENTION_LINE: the registers read back as written, events stay pending
+ * until acknowledged and only enabled ones pull the line low, the ADC
+ * threshold event fires on each crossing, and servoctl_attention_service()
+ * releases the line even when an event arrives while it runs, or gives up
+ * with -EAGAIN on one that never stops.
+ *
+ * usage: test_attention
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <msp430.h>
+
+#include "attention.h"
+#include "check.h"
+#include "fakedev.h"
+#include "firmware.h"
+#include "servoctl.h"
+
+#ifndef ATTENTION_LINE
+#error "test_attention needs ATTENTION_LINE"
+#endif
+
+#define THRESHOLD (512)
+
+/*
+ * Called after every message on the test bus, if set, as an interrupt on the
+ * device could run between them
+ */
+static void (*bus_hook)(void);
+static int race_countdown;
+
+/* The fake device's transfer, with bus_hook between the messages */
+static int hooked_xfer(void* ctx, servoctl_msg_t* msgs, unsigned count)
+{
+    int ret = 0;
+
+    (void)ctx;
+
+    for(unsigned i = 0; i < count && !ret; i++)
+    {
+        bool read = msgs[i].flags & SERVOCTL_MSG_READ;
+
+        fakedev_start();
+
+        if(!fakedev_write((msgs[i].addr << 1) | (read ? 1 : 0)))
+        {
+            ret = -ENXIO;
+            break;
+        }
+
+        for(uint16_t j = 0; j < msgs[i].len && !ret; j++)
+        {
+            if(read)
+                msgs[i].buf[j] = fakedev_read(j + 1 < msgs[i].len);
+            else if(!fakedev_write(msgs[i].buf[j]))
+                ret = -EIO;
+        }
+
+        if(bus_hook)
+            bus_hook();
+    }
+
+    fakedev_stop();
+
+    return ret;
+}
+
+static bool line_asserted(void)
+{
+    return (P1DIR & (1 << ATTN_PIN)) && !(P1OUT & (1 << ATTN_PIN));
+}
+
+static uint8_t read_status(servoctl_t* dev)
+{
+    uint8_t reg = offsetof(memmap_t, attention.status), status = 0xFF;
+    servoctl_msg_t msgs[2] = {
+        { dev->addr, 0, 1, &reg },
+        { dev->addr, SERVOCTL_MSG_READ, 1, &status },
+    };
+
+    if(servoctl_xfer(dev, msgs, 2))
+        return 0xFF;
+    return status;
+}
+
+static int ack(servoctl_t* dev, uint8_t events)
+{
+    uint8_t buf[2] = { offsetof(memmap_t, attention.ack), events };
+    servoctl_msg_t msg = { dev->addr, 0, sizeof(buf), buf };
+
+    return servoctl_xfer(dev, &msg, 1);
+}
+
+/* One reading on each ADC channel, in the order the interrupt takes them */
+static void adc_sample(uint16_t val0, uint16_t val1)
+{
+    ADC10MEM = val0;
+    firmware_adc10();
+    ADC10MEM = val1;
+    firmware_adc10();
+}
+
+/* Runs the slot interrupts for one frame */
+static void run_frame(void)
+{
+    for(uint8_t slot = 0; slot < SERVO_SLOTS; slot++)
+    {
+        firmware_timer0_a0();
+        TAIV = 0x02;
+        firmware_timer0_a1();
+    }
+}
+
+static int commit(servoctl_t* dev, uint16_t pos)
+{
+    int ret = servoctl_set_pos(dev, 0, pos);
+
+    if(!ret)
+        ret = servoctl_flush(dev);
+    firmware_service();
+    return ret;
+}
+
+/* Crosses the threshold once race_countdown messages have gone by */
+static void race_adc(void)
+{
+    if(--race_countdown)
+        return;
+
+    bus_hook = 0;
+    adc_sample(THRESHOLD + 100, 0);
+}
+
+int main(void)
+{
+    servoctl_bus_t bus;
+    servoctl_t dev;
+    memmap_t map;
+    uint8_t events;
+    int ret;
+
+    ret = servoctl_bus_fake(&bus);
+    bus.xfer = hooked_xfer;
+    if(!ret)
+        ret = servoctl_open(&dev, bus, I2C_SLAVE_ADDR);
+    if(ret)
+    {
+        fprintf(stderr, "fake device: %d\n", ret);
+        return 1;
+    }
+
+    CHECK(!line_asserted(), "line asserted after init: %02x", P1DIR);
+
+    // A delta no reading can reach keeps ATTN_ADC out of the way
+    ret = servoctl_attention_enable(&dev, ATTN_COMMIT | ATTN_ADC_LEVEL,
+                                    0xFFFF, THRESHOLD);
+    CHECK(!ret, "enable: %d", ret);
+    ret = servoctl_read(&dev, &map);
+    CHECK(!ret, "read: %d", ret);
+    CHECK(map.attention.enable == (ATTN_COMMIT | ATTN_ADC_LEVEL) &&
+          map.attention.adc_delta == 0xFFFF &&
+          map.attention.adc_threshold == THRESHOLD &&
+          !map.attention.ack && !map.attention.status,
+          "registers: %02x %u %u %02x %02x", map.attention.enable,
+          map.attention.adc_delta, map.attention.adc_threshold,
+          map.attention.ack, map.attention.status);
+
+    // An event that is not enabled is flagged but leaves the line alone
+    run_frame();
+    CHECK(read_status(&dev) == ATTN_FRAME, "status after frame: %02x",
+          read_status(&dev));
+    CHECK(!line_asserted(), "line asserted by a disabled event: %02x", P1DIR);
+    ret = ack(&dev, ATTN_FRAME);
+    CHECK(!ret && !read_status(&dev), "ack frame: %d %02x", ret,
+          read_status(&dev));
+
+    // A commit asserts the line, and reading the status does not clear it
+    ret = commit(&dev, 1000);
+    CHECK(!ret, "commit: %d", ret);
+    CHECK(line_asserted(), "line not asserted by a commit: %02x", P1DIR);
+    CHECK(read_status(&dev) == ATTN_COMMIT, "status after commit: %02x",
+          read_status(&dev));
+    CHECK(read_status(&dev) == ATTN_COMMIT && line_asserted(),
+          "status cleared by a read: %02x", read_status(&dev));
+
+    // Acknowledging other events keeps it pending
+    adc_sample(THRESHOLD + 1, 0);
+    ret = ack(&dev, ATTN_ADC_LEVEL);
+    CHECK(!ret && read_status(&dev) == ATTN_COMMIT && line_asserted(),
+          "partial ack: %d %02x", ret, read_status(&dev));
+    ret = ack(&dev, ATTN_COMMIT);
+    CHECK(!ret && !read_status(&dev) && !line_asserted(),
+          "ack commit: %d %02x", ret, read_status(&dev));
+
+    // The threshold event fires on each crossing, not on every reading above
+    adc_sample(THRESHOLD + 200, 0);
+    CHECK(!read_status(&dev), "no crossing: %02x", read_status(&dev));
+    adc_sample(THRESHOLD, 0);
+    CHECK(read_status(&dev) == ATTN_ADC_LEVEL && line_asserted(),
+          "falling crossing: %02x", read_status(&dev));
+    ret = servoctl_attention_service(&dev, &events);
+    CHECK(!ret && events == ATTN_ADC_LEVEL && !line_asserted(),
+          "service: %d %02x", ret, events);
+
+    // An event raised between reading the status and acknowledging it
+    ret = commit(&dev, 1500);
+    CHECK(!ret, "commit: %d", ret);
+    // Right after the first status read: W[status] Sr R[1]
+    race_countdown = 2;
+    bus_hook = race_adc;
+    ret = servoctl_attention_service(&dev, &events);
+    CHECK(!ret && events == (ATTN_COMMIT | ATTN_ADC_LEVEL),
+          "service with a racing event: %d %02x", ret, events);
+    CHECK(!read_status(&dev) && !line_asserted(),
+          "line left asserted: %02x", read_status(&dev));
+
+    // An event that comes with every transaction
+    ret = servoctl_attention_enable(&dev, ATTN_FRAME, 0xFFFF, THRESHOLD);
+    CHECK(!ret, "enable frame: %d", ret);
+    bus_hook = run_frame;
+    ret = servoctl_attention_service(&dev, &events);
+    CHECK(ret == -EAGAIN && (events & ATTN_FRAME) && line_asserted(),
+          "service with a frame per transaction: %d %02x", ret, events);
+    bus_hook = 0;
+    ret = servoctl_attention_service(&dev, &events);
+    CHECK(!ret && events == ATTN_FRAME && !line_asserted(),
+          "service after the frames stop: %d %02x", ret, events);
+
+    servoctl_close(&dev);
+
+    if(check_failures)
+        return 1;
+
+    printf("attention: all checks passed\n");
+    return 0;
+}
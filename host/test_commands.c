@@ -0,0 +1,198 @@
+/*
+ * test_commands.c
+ *
+ * Copyright (C) 2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *
+ *
+ * Checks the command block through the fake device, built with
+ * SERVO_COMMANDS: SET_CLAMP and ADD clamping to the band, SWAP and the other
+ * ops reaching the pulse without a commit, a command repeated by writing only
+ * its op byte, and the status and result read back after each.
+ *
+ * usage: test_commands
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include <msp430.h>
+
+#include "check.h"
+#include "fakedev.h"
+#include "firmware.h"
+#include "servoctl.h"
+
+#ifndef SERVO_COMMANDS
+#error "test_commands needs SERVO_COMMANDS"
+#endif
+
+/* Slot the firmware is in, followed from boot */
+static uint8_t slot;
+/* TA0CCR1 as each slot started, i.e. the channel's pulse width */
+static uint16_t slot_compare[SERVO_SLOTS];
+
+/* Runs the slot interrupts for one frame */
+static void run_frame(void)
+{
+    for(uint8_t i = 0; i < SERVO_SLOTS; i++)
+    {
+        firmware_timer0_a0();
+        slot = (slot + 1) % SERVO_SLOTS;
+        slot_compare[slot] = TA0CCR1;
+        TAIV = 0x02;
+        firmware_timer0_a1();
+    }
+}
+
+/*
+ * W[reg, data...] Sr W[cmd.op] Sr R[status, result], bypassing the checks
+ * servoctl_command() makes
+ */
+static int write_raw(servoctl_t* dev, uint8_t* cmd, uint16_t len,
+                     uint8_t* status, uint16_t* result)
+{
+    uint8_t reg = offsetof(memmap_t, command.op);
+    uint8_t back[3] = { 0xAA, 0xAA, 0xAA };
+    servoctl_msg_t msgs[3] = {
+        { dev->addr, 0, len, cmd },
+        { dev->addr, 0, 1, &reg },
+        { dev->addr, SERVOCTL_MSG_READ, sizeof(back), back },
+    };
+    int ret = servoctl_xfer(dev, msgs, 3);
+
+    *status = back[0];
+    *result = back[1] | (back[2] << 8);
+    return ret;
+}
+
+/* Writes only the op byte */
+static int write_op(servoctl_t* dev, uint8_t op, uint8_t* status,
+                    uint16_t* result)
+{
+    uint8_t cmd[2] = { offsetof(memmap_t, command.op), op };
+
+    return write_raw(dev, cmd, sizeof(cmd), status, result);
+}
+
+int main(void)
+{
+    servoctl_bus_t bus;
+    servoctl_t dev;
+    servo_ctl_t* servos;
+    uint16_t band, result;
+    uint8_t status;
+    int ret;
+
+    ret = servoctl_bus_fake(&bus);
+    if(!ret)
+        ret = servoctl_open(&dev, bus, I2C_SLAVE_ADDR);
+    if(ret)
+    {
+        fprintf(stderr, "fake device: %d\n", ret);
+        return 1;
+    }
+
+    servos = firmware_servos();
+    band = servos->maxband - servos->baseband;
+
+    // SET_CLAMP clamps to the band at both ends
+    ret = servoctl_command(&dev, SERVO_CMD_SET_CLAMP, 0, band + 100, &result);
+    CHECK(!ret && result == band && servos->pos[0] == band,
+          "set above the band: %d %u %u", ret, result, servos->pos[0]);
+    ret = servoctl_command(&dev, SERVO_CMD_SET_CLAMP, 0, -5, &result);
+    CHECK(!ret && result == 0 && servos->pos[0] == 0,
+          "set below the band: %d %u %u", ret, result, servos->pos[0]);
+
+    // ADD moves relative to the current position, saturating at both ends
+    ret = servoctl_command(&dev, SERVO_CMD_SET_CLAMP, 0, 100, &result);
+    CHECK(!ret && result == 100, "set: %d %u", ret, result);
+    ret = servoctl_command(&dev, SERVO_CMD_ADD, 0, 50, &result);
+    CHECK(!ret && result == 150 && servos->pos[0] == 150,
+          "add: %d %u %u", ret, result, servos->pos[0]);
+    ret = servoctl_command(&dev, SERVO_CMD_ADD, 0, -200, &result);
+    CHECK(!ret && result == 0, "add below the band: %d %u", ret, result);
+    ret = servoctl_command(&dev, SERVO_CMD_ADD, 0, INT16_MAX, &result);
+    CHECK(!ret && result == band, "add above the band: %d %u", ret, result);
+    CHECK(dev.shadow.servos.pos[0] == band, "local copy: %u",
+          dev.shadow.servos.pos[0]);
+
+    // SWAP returns the old position, and the pulse follows without a commit
+    ret = servoctl_command(&dev, SERVO_CMD_SET_CLAMP, 1, band / 4, &result);
+    CHECK(!ret, "set: %d", ret);
+    run_frame();
+    CHECK(slot_compare[1] == servos->baseband + band / 4, "pulse after set: %u",
+          slot_compare[1]);
+    ret = servoctl_command(&dev, SERVO_CMD_SWAP, 1, band * 3 / 4, &result);
+    CHECK(!ret && result == band / 4 && servos->pos[1] == band * 3 / 4,
+          "swap: %d %u %u", ret, result, servos->pos[1]);
+    CHECK(!firmware_commit_pending(), "commit pending after a command: %d",
+          firmware_commit_pending());
+    run_frame();
+    CHECK(slot_compare[1] == servos->baseband + band * 3 / 4,
+          "pulse after swap: %u", slot_compare[1]);
+    CHECK(slot_compare[0] == servos->baseband + band,
+          "other channel's pulse: %u", slot_compare[0]);
+
+    // Writing only the op byte repeats the command with the same operands
+    ret = servoctl_command(&dev, SERVO_CMD_SET_CLAMP, 0, 100, &result);
+    CHECK(!ret, "set: %d", ret);
+    ret = servoctl_command(&dev, SERVO_CMD_ADD, 0, 10, &result);
+    CHECK(!ret && result == 110, "add: %d %u", ret, result);
+    for(uint16_t expected = 120; expected <= 140; expected += 10)
+    {
+        ret = write_op(&dev, SERVO_CMD_ADD, &status, &result);
+        CHECK(!ret && status == SERVO_CMD_DONE && result == expected &&
+              servos->pos[0] == expected, "repeated add: %d %02x %u %u", ret,
+              status, result, servos->pos[0]);
+    }
+    run_frame();
+    CHECK(slot_compare[0] == servos->baseband + 140,
+          "pulse after repeats: %u", slot_compare[0]);
+
+    // SET_MASK writes every channel in the mask
+    ret = servoctl_command(&dev, SERVO_CMD_SET_MASK, SERVO_DIRTY_ALL, band / 3,
+                           &result);
+    CHECK(!ret && result == band / 3 && servos->pos[0] == band / 3 &&
+          servos->pos[1] == band / 3, "set mask: %d %u %u %u", ret, result,
+          servos->pos[0], servos->pos[1]);
+
+    // Unknown ops, and targets the library would refuse, read back as errors
+    ret = write_op(&dev, 0x42, &status, &result);
+    CHECK(!ret && status == SERVO_CMD_ERROR, "unknown op: %d %02x", ret,
+          status);
+    uint8_t cmd[5] = { offsetof(memmap_t, command), 0x10, 0x00, NUM_SERVOS,
+                       SERVO_CMD_SET_CLAMP };
+    ret = write_raw(&dev, cmd, sizeof(cmd), &status, &result);
+    CHECK(!ret && status == SERVO_CMD_ERROR && servos->pos[0] == band / 3 &&
+          servos->pos[1] == band / 3, "target out of range: %d %02x", ret,
+          status);
+    ret = servoctl_command(&dev, SERVO_CMD_SET_CLAMP, NUM_SERVOS, 0, &result);
+    CHECK(ret == -EINVAL, "library accepted a bad target: %d", ret);
+
+    servoctl_close(&dev);
+
+    if(check_failures)
+        return 1;
+
+    printf("commands: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * test_keyframe.c
+ *
+ * Copyright (C) 2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *
+ * Runs the keyframe queue through the fake device, built with
+ * SERVO_KEYFRAMES: the master reads the queue while a keyframe is waiting,
+ * the firmware takes it, and the master then writes the next keyframe to the
+ * entry it last saw free. Both keyframes have to play.
+ *
+ * usage: test_keyframe
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <msp430.h>
+
+#include "check.h"
+#include "fakedev.h"
+#include "firmware.h"
+#include "servoctl.h"
+
+#ifndef SERVO_KEYFRAMES
+#error "test_keyframe needs SERVO_KEYFRAMES"
+#endif
+
+#define CHANNEL (0)
+
+/* Runs the slot interrupts for one frame, then the main loop */
+static void run_frame(void)
+{
+    for(uint8_t slot = 0; slot < SERVO_SLOTS; slot++)
+    {
+        firmware_timer0_a0();
+        TAIV = 0x02;
+        firmware_timer0_a1();
+    }
+    firmware_service();
+}
+
+static int queue_keyframe(servoctl_t* dev, uint8_t entry, uint16_t pos,
+                          uint8_t frames)
+{
+    keyframe_t kf = { pos, 0, frames, 0 };
+    int ret = servoctl_stage(dev, offsetof(memmap_t, keyframes) +
+                             (CHANNEL * KEYFRAME_QUEUE_LEN + entry) *
+                             sizeof(keyframe_t), &kf, sizeof(kf));
+    return ret ? ret : servoctl_flush(dev);
+}
+
+int main(void)
+{
+    servoctl_bus_t bus;
+    servoctl_t dev;
+    memmap_t map;
+    int ret;
+
+    ret = servoctl_bus_fake(&bus);
+    if(!ret)
+        ret = servoctl_open(&dev, bus, I2C_SLAVE_ADDR);
+    if(ret)
+    {
+        fprintf(stderr, "fake device: %d\n", ret);
+        return 1;
+    }
+
+    // K1 waits in the head entry; the master sees [full, free]
+    ret = queue_keyframe(&dev, 0, 500, 4);
+    CHECK(!ret, "queue K1: %d", ret);
+    ret = servoctl_read(&dev, &map);
+    CHECK(!ret, "read: %d", ret);
+    CHECK(map.keyframes[CHANNEL][0].frames && !map.keyframes[CHANNEL][1].frames,
+          "queue after K1: %u %u", map.keyframes[CHANNEL][0].frames,
+          map.keyframes[CHANNEL][1].frames);
+
+    // The firmware takes K1 before the master writes K2 behind it
+    run_frame();
+    ret = queue_keyframe(&dev, 1, 1000, 4);
+    CHECK(!ret, "queue K2: %d", ret);
+
+    uint16_t peak = 0;
+    for(int frame = 0; frame < 16; frame++)
+    {
+        run_frame();
+        if(firmware_servos()->pos[CHANNEL] > peak)
+            peak = firmware_servos()->pos[CHANNEL];
+        if(frame == 2)
+            CHECK(firmware_servos()->pos[CHANNEL] == 500,
+                  "K1 end: %u", firmware_servos()->pos[CHANNEL]);
+    }
+
+    CHECK(firmware_servos()->pos[CHANNEL] == 1000,
+          "K2 not reached: %u", firmware_servos()->pos[CHANNEL]);
+    CHECK(peak == 1000, "peak position: %u", peak);
+
+    ret = servoctl_read(&dev, &map);
+    CHECK(!ret, "read: %d", ret);
+    for(int i = 0; i < KEYFRAME_QUEUE_LEN; i++)
+        CHECK(!map.keyframes[CHANNEL][i].frames, "entry %d left: %u", i,
+              map.keyframes[CHANNEL][i].frames);
+
+    servoctl_close(&dev);
+
+    if(check_failures)
+        return 1;
+
+    printf("keyframe: all checks passed\n");
+    return 0;
+}
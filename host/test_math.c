@@ -0,0 +1,324 @@
+/*
+ * test_math.c
+ *
+ * Copyright (C) 2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *
+ * Checks simple_math.h against 64-bit reference arithmetic, then times each
+ * operation. The 16-bit operations are checked for every value of one
+ * operand against the edge values of the other, plus random pairs (-x checks
+ * all 2^32 pairs instead, which takes a few minutes); recip_u16 for every
+ * input; the 32-bit divisions for edge values and random operands.
+ *
+ * Timings are host cycles (TSC) per call, averaged over many calls on
+ * varying operands. They rank the operations and show the cost of the
+ * shift-and-subtract division against the host's divider, not MSP430 cycles.
+ *
+ * usage: test_math [-x] [-n random pairs]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "simple_math.h"
+
+static unsigned long failures;
+
+#define CHECK(expr, fmt, ...) \
+    do \
+    { \
+        if(!(expr) && failures++ < 20) \
+            fprintf(stderr, "FAIL %s: " fmt "\n", __func__, __VA_ARGS__); \
+    } while(0)
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int64_t clamp64(int64_t v, int64_t lo, int64_t hi)
+{
+    return (v < lo) ? lo : ((v > hi) ? hi : v);
+}
+
+/* Every two-operand 16-bit operation against its reference, for one pair */
+static void check_pair(uint16_t a, uint16_t b)
+{
+    int16_t sa = (int16_t)a, sb = (int16_t)b;
+    int64_t r;
+
+    r = (a < b) ? a : b;
+    CHECK(lesser(a, b) == r, "%u %u", a, b);
+    r = (a > b) ? a : b;
+    CHECK(greater(a, b) == r, "%u %u", a, b);
+    r = (sa < sb) ? sa : sb;
+    CHECK(lesser_s16(sa, sb) == r, "%d %d", sa, sb);
+    r = (sa > sb) ? sa : sb;
+    CHECK(greater_s16(sa, sb) == r, "%d %d", sa, sb);
+    r = llabs((int64_t)a - b);
+    CHECK(distance(a, b) == r, "%u %u", a, b);
+
+    r = clamp64((int64_t)a + b, 0, UINT16_MAX);
+    CHECK(sat_add_u16(a, b) == r, "%u %u", a, b);
+    r = clamp64((int64_t)a - b, 0, UINT16_MAX);
+    CHECK(sat_sub_u16(a, b) == r, "%u %u", a, b);
+    r = clamp64((int64_t)a * b, 0, UINT16_MAX);
+    CHECK(sat_mul_u16(a, b) == r, "%u %u", a, b);
+    r = clamp64((int64_t)a + sb, 0, UINT16_MAX);
+    CHECK(sat_offset_u16(a, sb) == r, "%u %d", a, sb);
+
+    r = clamp64((int64_t)sa + sb, INT16_MIN, INT16_MAX);
+    CHECK(sat_add_s16(sa, sb) == r, "%d %d", sa, sb);
+    r = clamp64((int64_t)sa - sb, INT16_MIN, INT16_MAX);
+    CHECK(sat_sub_s16(sa, sb) == r, "%d %d", sa, sb);
+    // Floor, as the arithmetic shift does
+    r = (int64_t)sa * sb;
+    r = clamp64((r >= 0) ? r / 32768 : -((-r + 32767) / 32768),
+                INT16_MIN, INT16_MAX);
+    CHECK(q15_mul(sa, sb) == r, "%d %d", sa, sb);
+}
+
+/* Three-operand 16-bit operations, for a triple */
+static void check_triple(uint16_t a, uint16_t b, uint16_t t)
+{
+    int64_t r;
+
+    // Rounded towards a: C division truncates towards zero
+    r = a + ((int64_t)b - a) * t / 65536;
+    CHECK(lerp_u16(a, b, t) == r, "%u %u %u", a, b, t);
+
+    if(a <= b)
+    {
+        r = (t < a) ? a : ((t > b) ? b : t);
+        CHECK(clip(a, b, t) == r, "%u %u %u", a, b, t);
+    }
+}
+
+static const uint16_t edges16[] =
+{
+    0, 1, 2, 3, 0x7F, 0x80, 0xFF, 0x100, 0x3FFF, 0x4000, 0x7FFE, 0x7FFF,
+    0x8000, 0x8001, 0xBFFF, 0xC000, 0xFF00, 0xFFFE, 0xFFFF,
+};
+#define NUM_EDGES16 (sizeof(edges16) / sizeof(edges16[0]))
+
+static const uint32_t edges32[] =
+{
+    0, 1, 2, 0xFFFF, 0x10000, 0x10001, 0x7FFFFFFF, 0x80000000, 0x80000001,
+    0xFFFEFFFF, 0xFFFF0000, 0xFFFFFFFE, 0xFFFFFFFF,
+};
+#define NUM_EDGES32 (sizeof(edges32) / sizeof(edges32[0]))
+
+static void check_16(bool exhaustive, unsigned long pairs)
+{
+    if(exhaustive)
+    {
+        for(uint32_t a = 0; a <= UINT16_MAX; a++)
+            for(uint32_t b = 0; b <= UINT16_MAX; b++)
+                check_pair(a, b);
+    }
+    else
+    {
+        for(uint32_t a = 0; a <= UINT16_MAX; a++)
+        {
+            for(size_t e = 0; e < NUM_EDGES16; e++)
+            {
+                check_pair(a, edges16[e]);
+                check_pair(edges16[e], a);
+            }
+        }
+        for(unsigned long i = 0; i < pairs; i++)
+        {
+            uint64_t v = rng();
+            check_pair(v, v >> 16);
+        }
+    }
+
+    for(size_t i = 0; i < NUM_EDGES16; i++)
+        for(size_t j = 0; j < NUM_EDGES16; j++)
+            for(uint32_t t = 0; t <= UINT16_MAX; t++)
+                check_triple(edges16[i], edges16[j], t);
+    for(unsigned long i = 0; i < pairs; i++)
+    {
+        uint64_t v = rng();
+        check_triple(v, v >> 16, v >> 32);
+    }
+}
+
+static void check_div_one(uint32_t num, uint16_t den)
+{
+    uint16_t rem;
+    uint32_t q = udiv32_16(num, den, &rem);
+
+    if(den)
+        CHECK(q == num / den && rem == num % den, "%u / %u", num, den);
+    else
+        CHECK(q == UINT32_MAX && rem == 0, "%u / 0", num);
+    CHECK(udiv32_16(num, den, NULL) == q, "%u / %u", num, den);
+
+    for(uint8_t shift = 0; shift <= 16; shift++)
+    {
+        uint64_t r = den ? ((uint64_t)num << shift) / den : UINT64_MAX;
+        r = (r > UINT32_MAX) ? UINT32_MAX : r;
+        CHECK(udiv_shift(num, den, shift) == r,
+              "(%u << %u) / %u", num, shift, den);
+    }
+
+    for(int sign = 0; sign < 2; sign++)
+    {
+        int32_t n = sign ? -(int32_t)(num >> 1) : (int32_t)(num >> 1);
+        int64_t r;
+
+        if(!den)
+            r = (n < 0) ? -INT32_MAX : INT32_MAX;
+        else
+            r = clamp64((int64_t)n * 65536 / den, -INT32_MAX, INT32_MAX);
+        CHECK(q16_div(n, den) == r, "%d / %u", n, den);
+    }
+    CHECK(q16_div(INT32_MIN, den) ==
+          (den ? clamp64((int64_t)INT32_MIN * 65536 / den, -INT32_MAX,
+                         INT32_MAX) : -INT32_MAX), "%d / %u", INT32_MIN, den);
+}
+
+static void check_div(unsigned long pairs)
+{
+    for(uint32_t den = 0; den <= UINT16_MAX; den++)
+    {
+        uint32_t r = (den <= 1) ? UINT16_MAX : 65536 / den;
+        CHECK(recip_u16(den) == r, "%u", den);
+
+        for(size_t e = 0; e < NUM_EDGES32; e++)
+            check_div_one(edges32[e], den);
+    }
+
+    for(unsigned long i = 0; i < pairs / 16; i++)
+    {
+        uint64_t v = rng();
+        // Small divisors too, where the quotient uses all 32 bits
+        uint16_t den = (v & 1) ? (v >> 32) : (v >> 32) & 0xFF;
+        check_div_one(v, den);
+    }
+}
+
+/* Operand pool for the timings, so nothing folds to a constant */
+#define POOL 4096
+static uint32_t pool[POOL];
+static volatile uint32_t sink;
+
+static uint64_t now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+#define TIME(name, expr) \
+    do \
+    { \
+        uint32_t acc = 0; \
+        uint64_t start = now(); \
+        for(unsigned rep = 0; rep < reps; rep++) \
+            for(unsigned i = 0; i < POOL; i++) \
+            { \
+                uint32_t x = pool[i], y = pool[(i + 1) & (POOL - 1)]; \
+                acc += (expr); \
+            } \
+        sink = acc; \
+        printf("%-12s %8.2f\n", name, \
+               (double)(now() - start) / ((double)reps * POOL)); \
+    } while(0)
+
+static void bench(void)
+{
+    const unsigned reps = 2000;
+
+    for(unsigned i = 0; i < POOL; i++)
+        pool[i] = rng();
+
+#if defined(__x86_64__) || defined(__i386__)
+    printf("operation    cycles/op (TSC)\n");
+#else
+    printf("operation    ns/op\n");
+#endif
+    TIME("sat_add_u16", sat_add_u16(x, y));
+    TIME("sat_sub_u16", sat_sub_u16(x, y));
+    TIME("sat_mul_u16", sat_mul_u16(x, y));
+    TIME("sat_add_s16", sat_add_s16(x, y));
+    TIME("q15_mul", q15_mul(x, y));
+    TIME("lerp_u16", lerp_u16(x, y, x >> 16));
+    TIME("recip_u16", recip_u16(x ^ y));
+    TIME("udiv32_16", udiv32_16(x, y | 1, NULL));
+    TIME("udiv_shift", udiv_shift(x >> 8, y | 1, 8));
+    TIME("q16_div", q16_div(x >> 12, y | 1));
+    // The host divider, for scale
+    TIME("native /", x / (uint16_t)(y | 1));
+}
+
+int main(int argc, char** argv)
+{
+    bool exhaustive = false;
+    unsigned long pairs = 1ul << 24;
+    int opt;
+
+    while((opt = getopt(argc, argv, "xn:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'x':
+                exhaustive = true;
+                break;
+            case 'n':
+                pairs = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-x] [-n random pairs]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    check_16(exhaustive, pairs);
+    check_div(pairs);
+
+    if(failures)
+    {
+        fprintf(stderr, "%lu failures\n", failures);
+        return 1;
+    }
+    printf("simple_math: all checks passed\n\n");
+
+    bench();
+    return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * test_paged.c
+ *
+ * Copyright (C) 2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ *
+ * Checks paged register addressing through the fake device, built with
+ * I2C_PAGED_ADDRESSING. The firmware's map is replaced by one 600-byte
+ * region, so bursts cross page boundaries: writes and reads on a selected
+ * page, runs across a boundary, reading the page register back, and the
+ * page going back to 0 in the next transaction.
+ *
+ * usage: test_paged
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "check.h"
+#include "fakedev.h"
+#include "i2c_memdev.h"
+#include "servoctl.h"
+
+#ifndef I2C_PAGED_ADDRESSING
+#error "test_paged needs I2C_PAGED_ADDRESSING"
+#endif
+
+#define MEM_LEN (600)
+
+static uint8_t mem[MEM_LEN];
+static const i2c_region_t regions[] =
+{
+    { 0, MEM_LEN, mem, I2C_REGION_READ | I2C_REGION_WRITE, 0, 0 },
+};
+
+/* W[page reg, page] Sr W[reg, data...] */
+static int paged_write(servoctl_t* dev, uint8_t page, uint8_t reg,
+                       const uint8_t* data, uint16_t len)
+{
+    uint8_t sel[2] = { I2C_PAGE_REG, page };
+    uint8_t buf[64];
+    servoctl_msg_t msgs[2] = {
+        { dev->addr, 0, sizeof(sel), sel },
+        { dev->addr, 0, len + 1, buf },
+    };
+
+    buf[0] = reg;
+    memcpy(&buf[1], data, len);
+    return servoctl_xfer(dev, msgs, 2);
+}
+
+/* W[page reg, page] Sr W[reg] Sr R[len], or without the page if page < 0 */
+static int paged_read(servoctl_t* dev, int page, uint8_t reg, uint8_t* data,
+                      uint16_t len)
+{
+    uint8_t sel[2] = { I2C_PAGE_REG, page };
+    servoctl_msg_t msgs[3] = {
+        { dev->addr, 0, sizeof(sel), sel },
+        { dev->addr, 0, 1, &reg },
+        { dev->addr, SERVOCTL_MSG_READ, len, data },
+    };
+
+    return (page < 0) ? servoctl_xfer(dev, &msgs[1], 2)
+                      : servoctl_xfer(dev, msgs, 3);
+}
+
+int main(void)
+{
+    servoctl_bus_t bus;
+    servoctl_t dev;
+    uint8_t data[32], back[32];
+    int ret;
+
+    ret = servoctl_bus_fake(&bus);
+    if(!ret)
+        ret = servoctl_open(&dev, bus, I2C_SLAVE_ADDR);
+    if(ret)
+    {
+        fprintf(stderr, "fake device: %d\n", ret);
+        return 1;
+    }
+
+    i2c_init_regions(regions, 1);
+
+    for(unsigned i = 0; i < sizeof(data); i++)
+        data[i] = 0xA0 + i;
+
+    // Inside page 1
+    ret = paged_write(&dev, 1, 0x10, data, 8);
+    CHECK(!ret, "write page 1: %d", ret);
+    CHECK(!memcmp(&mem[0x110], data, 8), "page 1 contents %02x", mem[0x110]);
+
+    // From page 1 into page 2, over the byte only a burst reaches
+    ret = paged_write(&dev, 1, 0xF8, data, 16);
+    CHECK(!ret, "write across pages: %d", ret);
+    CHECK(!memcmp(&mem[0x1F8], data, 16), "across pages %02x %02x",
+          mem[0x1FF], mem[0x200]);
+
+    ret = paged_read(&dev, 1, 0xF8, back, 16);
+    CHECK(!ret, "read across pages: %d", ret);
+    CHECK(!memcmp(back, data, 16), "read back %02x %02x", back[7], back[8]);
+
+    // Up to the end of the map on page 2
+    ret = paged_read(&dev, 2, MEM_LEN - 0x200 - 4, back, 4);
+    CHECK(!ret, "read map end: %d", ret);
+    CHECK(!memcmp(back, &mem[MEM_LEN - 4], 4), "map end %02x", back[0]);
+
+    // The page register reads back within the transaction
+    uint8_t page_reg = I2C_PAGE_REG, page = 0;
+    uint8_t sel[2] = { I2C_PAGE_REG, 2 };
+    servoctl_msg_t msgs[3] = {
+        { dev.addr, 0, sizeof(sel), sel },
+        { dev.addr, 0, 1, &page_reg },
+        { dev.addr, SERVOCTL_MSG_READ, 1, &page },
+    };
+    ret = servoctl_xfer(&dev, msgs, 3);
+    CHECK(!ret && page == 2, "page register: %d %u", ret, page);
+
+    // The next transaction is back on page 0
+    mem[0x10] = 0x5A;
+    ret = paged_read(&dev, -1, 0x10, back, 1);
+    CHECK(!ret && back[0] == 0x5A, "page after stop: %d %02x", ret, back[0]);
+    ret = servoctl_xfer(&dev, &msgs[1], 2);
+    CHECK(!ret && page == 0, "page register after stop: %d %u", ret, page);
+
+    servoctl_close(&dev);
+
+    if(check_failures)
+        return 1;
+
+    printf("paged addressing: all checks passed\n");
+    return 0;
+}
@@ -29,6 +29,10 @@
 
 #include "i2c_memdev.h"
 
+#ifndef __MSP430_HAS_USI__
+#error "The I2C driver needs the USI module; USCI parts (G2x53) are not supported"
+#endif
+
 #define USIDIR_IN() do {\
     USICTL0 &= ~USIOE; \
 } while(0)
@@ -45,6 +49,9 @@
     USICTL1 &= ~USIIFG; \
 } while(0)
 
+/* Register index that is past the end of any memory */
+#define I2C_IDX_NONE (0xFFFF)
+
 typedef enum
 {
     I2CS_IDLE = 0,
@@ -60,16 +67,36 @@ typedef enum
 } i2c_state_e;
 
 static struct {
-    uint8_t *writemem;
-    const uint8_t *readmem;
-    uint16_t writelen, readlen, idx;
+    const i2c_region_t *regions, *region;
+    uint8_t num_regions;
+    uint8_t written;
+    uint16_t idx;
     bool have_address, read;
     bool busy;
+#ifdef I2C_PAGED_ADDRESSING
+    uint8_t page;
+    bool page_reg;
+#endif
     slvaddr_t addr;
     uint8_t chksum;
     i2c_state_e state;
 } i2c_state;
 
+/**
+ * @brief Runs the completion hooks of the regions written in the transaction
+ * that just ended.
+ */
+static void i2c_complete()
+{
+    uint8_t written = i2c_state.written;
+
+    i2c_state.written = 0;
+
+    for(uint8_t i = 0; written; i++, written >>= 1)
+        if((written & 1) && i2c_state.regions[i].on_complete)
+            i2c_state.regions[i].on_complete();
+}
+
 /**
  * @brief Determines whether or not the I2C memory is busy (being written to).
  *
@@ -78,19 +105,33 @@ static struct {
  * master has partially updated a multi-byte field in the memory and the memory
  * is then accessed for some other purpose.
  *
+ * This is also where a stop condition ending a write is noticed, so it should
+ * be called regularly from the main loop (not from interrupt handlers).
+ *
  * @return Whether or not the memory is busy.
  */
 bool i2c_busy()
 {
+    bool busy;
+
+    _BIC_SR(GIE);
+
     /*
      * Handle case where master writes partial memory and then ends
      * transmission, leaving state machine hung in I2CS_RX_DONE with the USISTP
      * flag set.
      */
     if (i2c_state.busy && i2c_state.state == I2CS_RX_DONE && (USICTL1 & USISTP))
-        return (i2c_state.busy = false);
+    {
+        i2c_state.busy = false;
+        i2c_complete();
+    }
 
-    return i2c_state.busy;
+    busy = i2c_state.busy;
+
+    _BIS_SR(GIE);
+
+    return busy;
 }
 
 /* Dummy implementation to keep linker from complaining. */
@@ -98,27 +139,44 @@ __attribute__((weak))
 void i2c_indicate_activity() {}
 
 /**
- * @brief Initializes the writable memory region.
+ * @brief Sets the memory regions mapped into the register address space.
  *
- * @param mem A pointer to the memory to be made writable via I2C.
- * @param len The length of the memory.
+ * @param regions The region table. It is used in place, so it must outlive the
+ * driver; regions must not overlap.
+ * @param count The number of regions, at most I2C_MAX_REGIONS.
  */
-void i2c_init_writemem(uint8_t* mem, uint8_t len)
+void i2c_init_regions(const i2c_region_t* regions, uint8_t count)
 {
-    i2c_state.writemem = mem;
-    i2c_state.writelen = (mem) ? (len) : 0;
+    i2c_state.regions = regions;
+    i2c_state.region = 0;
+    i2c_state.num_regions = (!regions) ? 0 :
+        (count > I2C_MAX_REGIONS) ? I2C_MAX_REGIONS : count;
 }
 
 /**
- * @brief Initializes the readable memory region.
+ * @brief Finds the region covering a register address.
+ *
+ * The last region found is checked first, since bursts usually stay in one.
  *
- * @param mem A pointer to the memory to be made readable via I2C.
- * @param len The length of the memory.
+ * @param idx The register address.
+ *
+ * @return The region, or null if the address is not mapped.
  */
-void i2c_init_readmem(const uint8_t* mem, uint8_t len)
+static const i2c_region_t* i2c_find_region(uint16_t idx)
 {
-    i2c_state.readmem = mem;
-    i2c_state.readlen = (mem) ? (len) : 0;
+    const i2c_region_t* region = i2c_state.region;
+
+    if(region && (uint16_t)(idx - region->addr) < region->len)
+        return region;
+
+    for(uint8_t i = 0; i < i2c_state.num_regions; i++)
+    {
+        region = &i2c_state.regions[i];
+        if((uint16_t)(idx - region->addr) < region->len)
+            return (i2c_state.region = region);
+    }
+
+    return 0;
 }
 
 /**
@@ -131,6 +189,7 @@ static void i2c_reset()
     //i2c_state.idx = 0;
     //i2c_state.have_address = false;
     i2c_state.busy = false;
+    i2c_complete();
     i2c_state.state = I2CS_IDLE;
     i2c_state.chksum = I2C_CHECKSUM_MAGIC;
 }
@@ -140,7 +199,7 @@ static void i2c_reset()
  *
  * After calling this function, the driver ISRs will be enabled, and can begin
  * servicing I2C communications immediately. Before calling this function, the
- * read and write memories should be initialized with i2c_init_(read|write)mem.
+ * register map should be set up with i2c_init_regions.
  *
  * @param slave_addr The slave address the driver should use.
  */
@@ -175,6 +234,8 @@ void i2c_init_mem(slvaddr_t slave_addr)
 
 __attribute__((__interrupt__(USI_VECTOR)))
 static void usi_int() {
+    const i2c_region_t* region;
+
     _BIC_SR(GIE);
 
     if (USICTL1 & USISTTIFG)
@@ -182,6 +243,10 @@ static void usi_int() {
         if (USICTL1 & USISTP)
         {
             i2c_reset();
+#ifdef I2C_PAGED_ADDRESSING
+            // Each transaction starts on page 0
+            i2c_state.page = 0;
+#endif
 
             USICTL1 &= ~USISTP;
         }
@@ -233,6 +298,9 @@ static void usi_int() {
                     i2c_state.state = I2CS_TX;
                     i2c_state.idx = 0;
                     i2c_state.have_address = true;
+#ifdef I2C_PAGED_ADDRESSING
+                    i2c_state.page_reg = false;
+#endif
 #else
                     i2c_state.state = I2CS_NACK_DONE;
                     USISRL = 0xFF;
@@ -269,7 +337,12 @@ static void usi_int() {
     case I2CS_RXDATADDR_DONE:
         i2c_state.state = I2CS_RX;
 
+#ifdef I2C_PAGED_ADDRESSING
+        i2c_state.page_reg = (USISRL == I2C_PAGE_REG);
+        i2c_state.idx = ((uint16_t)i2c_state.page << 8) | USISRL;
+#else
         i2c_state.idx = USISRL;
+#endif
         i2c_state.have_address = true;
 
         USIDIR_OUT();
@@ -294,13 +367,31 @@ static void usi_int() {
          */
         i2c_state.have_address = false;
 
-        if(i2c_state.idx < i2c_state.writelen)
+#ifdef I2C_PAGED_ADDRESSING
+        if(i2c_state.page_reg)
+        {
+            // The page register is one byte; anything after it is NACKed
+            i2c_state.page_reg = false;
+            i2c_state.page = USISRL;
+            i2c_state.idx = I2C_IDX_NONE;
+            USISRL = 0x00;
+        }
+        else
+#endif
+        if((region = i2c_find_region(i2c_state.idx)) &&
+           (region->access & I2C_REGION_WRITE))
         {
+            uint16_t offset = i2c_state.idx++ - region->addr;
+
             i2c_indicate_activity();
 
             i2c_state.busy = true;
-            i2c_state.writemem[i2c_state.idx++] = USISRL;
+            i2c_state.written |= 1 << (region - i2c_state.regions);
+            region->mem[offset] = USISRL;
             USISRL = 0x00;
+
+            if(region->on_write)
+                region->on_write(offset);
         }
         else
         {
@@ -328,11 +419,23 @@ static void usi_int() {
 
             USIDIR_OUT();
 
-            if(i2c_state.idx < i2c_state.readlen)
+#ifdef I2C_PAGED_ADDRESSING
+            if(i2c_state.page_reg)
+            {
+                i2c_state.page_reg = false;
+                i2c_state.idx = I2C_IDX_NONE;
+
+                USISRL = i2c_state.page;
+                i2c_state.chksum ^= USISRL;
+            }
+            else
+#endif
+            if((region = i2c_find_region(i2c_state.idx)) &&
+               (region->access & I2C_REGION_READ))
             {
                 i2c_indicate_activity();
 
-                USISRL = i2c_state.readmem[i2c_state.idx++];
+                USISRL = region->mem[i2c_state.idx++ - region->addr];
                 i2c_state.chksum ^= USISRL;
             }
             else
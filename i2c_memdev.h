@@ -35,14 +35,57 @@
  */
 #define READ_NOADDR_FROM_START
 
+/*
+ * Uncomment this to address register maps larger than 256 bytes. Writing a
+ * byte to register I2C_PAGE_REG selects the page (the high byte of the
+ * address) that later single-byte register addresses refer to; reading it
+ * returns the current page. Every transaction starts on page 0, so masters
+ * that never touch I2C_PAGE_REG see the first 256 bytes exactly as before,
+ * and a master that restarts mid-way cannot inherit a stale page. The page
+ * holds across repeated starts, so select it in the same transaction:
+ * W[I2C_PAGE_REG, page] Sr W[reg, data...] or W[I2C_PAGE_REG, page] Sr
+ * W[reg] Sr R[...]. Bursts run on across page boundaries; the last byte of
+ * each page can only be reached that way, since its address selects the page
+ * register.
+ */
+//#define I2C_PAGED_ADDRESSING
+
+#define I2C_PAGE_REG (0xFF)
+
 #define I2C_CHECKSUM_MAGIC (0xAA)
 
+/* Largest number of regions in a table */
+#define I2C_MAX_REGIONS (8)
+
+#define I2C_REGION_READ (0x01)
+#define I2C_REGION_WRITE (0x02)
+
 typedef uint8_t slvaddr_t;
 
+/*
+ * A range of register addresses backed by some structure in memory. Addresses
+ * that no region covers, or that the region does not allow writing, are
+ * NACKed when written; reading them returns the checksum, as reading past the
+ * end of the map always has.
+ *
+ * on_write is called from the USI interrupt after each byte written, with the
+ * byte's offset into the region. on_complete is called once the transaction
+ * that wrote into the region has ended, either from the USI interrupt or from
+ * i2c_busy() (stop conditions are only noticed lazily). Either may be null.
+ */
+typedef struct
+{
+    uint16_t addr;
+    uint16_t len;
+    uint8_t* mem;
+    uint8_t access;
+    void (*on_write)(uint16_t offset);
+    void (*on_complete)();
+} i2c_region_t;
+
 bool i2c_busy();
 void i2c_indicate_activity();
 void i2c_init_mem(slvaddr_t slave_addr);
-void i2c_init_readmem(const uint8_t* mem, uint8_t len);
-void i2c_init_writemem(uint8_t* mem, uint8_t len);
+void i2c_init_regions(const i2c_region_t* regions, uint8_t count);
 
 #endif // I2C_MEMDEV_H
@@ -0,0 +1,234 @@
+/*
+ * keyframe.c
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Each segment between two keyframes is a cubic Hermite curve in the frame
+ * index s = 0..N:
+ *
+ *   p(s) = A s^3 + B s^2 + m0 s + p0
+ *   A = ((m0 + m1) N - 2 (p1 - p0)) / N^3
+ *   B = (3 (p1 - p0) - (2 m0 + m1) N) / N^2
+ *
+ * It is evaluated by forward differencing, so once a segment is set up each
+ * frame costs three 32-bit additions. The divisions only happen at the start of
+ * a segment.
+ */
+
+#include "keyframe.h"
+
+#include <string.h>
+
+#include "global_const.h"
+#include "simple_math.h"
+
+#ifdef SERVO_KEYFRAMES
+
+typedef struct
+{
+    /* Position and its forward differences, 16.16 */
+    q16_t p, d1, d2, d3;
+    /* Slope at the end of the current segment, 8.8 */
+    int16_t tangent;
+    uint16_t target;
+    uint8_t remaining;
+} keyframe_state_t;
+
+static keyframe_queue_t* keyframes;
+static keyframe_state_t keyframe_state[NUM_SERVOS];
+
+/**
+ * @brief Divides an 8.8 value by n^powers, giving a 16.16 result.
+ *
+ * Nested floor divisions equal a single floor division by the product, so the
+ * result is exact to within one LSB.
+ */
+static q16_t keyframe_div(int32_t num, uint8_t n, uint8_t powers)
+{
+    uint32_t q = udiv_shift((num < 0) ? -(uint32_t)num : (uint32_t)num, n, 8);
+
+    while(--powers)
+        q = udiv32_16(q, n, 0);
+
+    if(q > INT32_MAX)
+        q = INT32_MAX;
+
+    return (num < 0) ? -(q16_t)q : (q16_t)q;
+}
+
+static int16_t keyframe_clamp_tangent(int32_t m)
+{
+    if(m > KEYFRAME_MAX_TANGENT)
+        return KEYFRAME_MAX_TANGENT;
+    if(m < -KEYFRAME_MAX_TANGENT)
+        return -KEYFRAME_MAX_TANGENT;
+    return m;
+}
+
+/**
+ * @brief Sets up the forward differences for the segment towards a keyframe.
+ *
+ * @param st The channel's interpolator state.
+ * @param p0 The position the segment starts from.
+ * @param kf The keyframe to move to.
+ * @param next The keyframe after that, used for automatic tangents. May be
+ * null or free (frames == 0).
+ */
+static void keyframe_begin(keyframe_state_t* st, uint16_t p0,
+                           const keyframe_t* kf, const keyframe_t* next)
+{
+    uint8_t n = lesser(kf->frames, KEYFRAME_MAX_FRAMES);
+    uint16_t p1 = lesser(kf->pos, KEYFRAME_MAX_POS);
+    int16_t m0 = st->tangent;
+    int16_t m1 = kf->tangent;
+
+    p0 = lesser(p0, KEYFRAME_MAX_POS);
+
+    if(m1 == KEYFRAME_AUTO_TANGENT)
+    {
+        /*
+         * Slope of the chord from the start of this segment to the next
+         * keyframe; ease in if the master has not queued one. keyframe_div()
+         * scales by 2^8, so a whole-position numerator gives an 8.8 slope.
+         */
+        if(next && next->frames)
+            m1 = keyframe_clamp_tangent(keyframe_div(
+                    (int32_t)lesser(next->pos, KEYFRAME_MAX_POS) - p0,
+                    n + lesser(next->frames, KEYFRAME_MAX_FRAMES), 1));
+        else
+            m1 = 0;
+    }
+    else
+    {
+        m1 = keyframe_clamp_tangent(m1);
+    }
+
+    int32_t delta = (int32_t)p1 - p0;
+
+    // A * N^3 and B * N^2, both 8.8
+    int32_t a = ((int32_t)m0 + m1) * n - delta * 512;
+    int32_t b = delta * 768 - (2 * (int32_t)m0 + m1) * n;
+
+    q16_t d3 = keyframe_div(6 * a, n, 3);
+    q16_t b2 = keyframe_div(2 * b, n, 2);
+
+    st->p = (q16_t)p0 << 16;
+    st->d3 = d3;
+    st->d2 = (q16_t)((uint32_t)d3 + (uint32_t)b2);
+    // d3 / 6 rounded towards zero, and b2 / 2 rounded down
+    q16_t d3_6 = (d3 < 0) ? -(q16_t)udiv32_16(-(uint32_t)d3, 6, 0)
+                          : (q16_t)udiv32_16(d3, 6, 0);
+    st->d1 = d3_6 + (b2 >> 1) + ((q16_t)m0 << 8);
+    st->tangent = m1;
+    st->target = p1;
+    st->remaining = n;
+}
+
+/**
+ * @brief Initializes the keyframe interpolator.
+ *
+ * @param queue The keyframe queue the master writes to.
+ */
+void keyframe_init(keyframe_queue_t* queue)
+{
+    keyframes = queue;
+
+    memset(queue, 0, sizeof(keyframe_queue_t));
+    memset(keyframe_state, 0, sizeof(keyframe_state));
+}
+
+/**
+ * @brief Advances every channel's motion by one frame.
+ *
+ * Call this once per servo frame. Channels that are not following a keyframe
+ * are left alone.
+ *
+ * @param ctl The control structure to write positions to.
+ * @param queue_ready Whether the queue may be read (not being written by the
+ * master). If not, new segments are not started this frame.
+ *
+ * @return Bitmask of the channels whose position changed.
+ */
+uint8_t keyframe_step(servo_ctl_t* ctl, bool queue_ready)
+{
+    uint8_t changed = 0;
+
+    for(uint8_t i = 0; i < NUM_SERVOS; i++)
+    {
+        keyframe_state_t* st = &keyframe_state[i];
+        keyframe_t* queue = (*keyframes)[i];
+
+        if(!st->remaining && queue_ready)
+        {
+            /*
+             * The master may have filled a later entry after it last saw
+             * the queue (e.g. [full, free] read, the head then taken, the
+             * new keyframe written to the second entry). Move the waiting
+             * entries up, in order, so such a queue does not stall.
+             */
+            uint8_t used = 0;
+            for(uint8_t j = 0; j < KEYFRAME_QUEUE_LEN; j++)
+            {
+                if(!queue[j].frames)
+                    continue;
+                if(j != used)
+                {
+                    queue[used] = queue[j];
+                    queue[j].frames = 0;
+                }
+                used++;
+            }
+        }
+
+        if(!st->remaining && queue_ready && queue[0].frames)
+        {
+            keyframe_begin(st, ctl->pos[i], &queue[0],
+                           (KEYFRAME_QUEUE_LEN > 1) ? &queue[1] : 0);
+
+            memmove(&queue[0], &queue[1],
+                    sizeof(keyframe_t) * (KEYFRAME_QUEUE_LEN - 1));
+            queue[KEYFRAME_QUEUE_LEN - 1].frames = 0;
+#ifdef ATTENTION_LINE
+            keyframe_indicate_free(i);
+#endif
+        }
+
+        if(!st->remaining)
+        {
+            // Coming to rest; the next segment starts with zero slope
+            st->tangent = 0;
+            continue;
+        }
+
+        st->p += st->d1;
+        st->d1 += st->d2;
+        st->d2 += st->d3;
+
+        if(--st->remaining == 0)
+            st->p = (q16_t)st->target << 16;
+
+        ctl->pos[i] = (st->p < 0) ? 0 : (uint16_t)((st->p + 0x8000) >> 16);
+        changed |= 1 << i;
+    }
+
+    return changed;
+}
+
+#endif // SERVO_KEYFRAMES
@@ -0,0 +1,83 @@
+/*
+ * keyframe.h
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#ifndef KEYFRAME_H
+#define KEYFRAME_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "servo.h"
+
+/*
+ * Uncomment this to enable keyframe motion. The queue and the interpolator
+ * state take about 40 bytes of RAM per channel, which the msp430g2231 does not
+ * have to spare.
+ */
+//#define SERVO_KEYFRAMES
+
+/* Number of keyframes the master can queue ahead, per channel */
+#define KEYFRAME_QUEUE_LEN (2)
+
+/*
+ * Limits that keep the fixed-point interpolator in range. Longer moves are
+ * split into several keyframes by the master.
+ */
+#define KEYFRAME_MAX_FRAMES (64)
+#define KEYFRAME_MAX_POS (2047)
+#define KEYFRAME_MAX_TANGENT (32 << 8)
+
+/*
+ * Tangent value asking the firmware to pick the slope at the keyframe itself
+ * (Catmull-Rom style, from the neighbouring keyframes).
+ */
+#define KEYFRAME_AUTO_TANGENT INT16_MIN
+
+typedef struct
+{
+    /* Position to reach, in the same units as servo_ctl_t.pos */
+    uint16_t pos;
+    /* Slope at pos, in ticks per frame (8.8), or KEYFRAME_AUTO_TANGENT */
+    int16_t tangent;
+    /*
+     * Frames from the previous keyframe to this one. 0 marks the entry as
+     * free; write it last. The master may write any free entry: entries are
+     * played in queue order, and free ones ahead of a full one are skipped.
+     */
+    uint8_t frames;
+    uint8_t pad;
+} keyframe_t;
+
+typedef keyframe_t keyframe_queue_t[NUM_SERVOS][KEYFRAME_QUEUE_LEN];
+
+void keyframe_init(keyframe_queue_t* queue);
+uint8_t keyframe_step(servo_ctl_t* ctl, bool queue_ready);
+
+/*
+ * Called from keyframe_step(), in the main loop, when a queue entry is taken
+ * and freed (attention.c)
+ */
+void keyframe_indicate_free(uint8_t servo);
+
+#endif // KEYFRAME_H
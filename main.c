@@ -22,33 +22,51 @@
 
 #include <msp430.h>
 
+#include <stddef.h>
 #include <string.h>
 
 #include "adc.h"
+#include "attention.h"
 #include "i2c_memdev.h"
+#include "keyframe.h"
+#include "memmap.h"
 #include "servo.h"
 #include "simple_io.h"
 #include "simple_math.h"
 
-#define COMMIT_MAGIC_NUMBER (0b101)
+servo_ctl_t shadow_servos;
 
+/*
+ * The tail of servo_ctl_t (bands and refresh dividers) as the master writes
+ * it. These reshape every pulse, so they are held here and copied into
+ * shadow_servos on commit; positions are written in place.
+ */
 typedef struct
 {
-    uint8_t commit : 3;
-    uint8_t pad : 5;
-    uint8_t pad2;
-} control_word_t;
+    uint16_t baseband, maxband;
+    uint8_t refresh_div[NUM_SERVOS];
+} servo_cfg_t;
 
-servo_ctl_t shadow_servos;
+_Static_assert(sizeof(servo_cfg_t) ==
+               sizeof(servo_ctl_t) - offsetof(servo_ctl_t, baseband) &&
+               offsetof(servo_cfg_t, refresh_div) ==
+               offsetof(servo_ctl_t, refresh_div) -
+               offsetof(servo_ctl_t, baseband),
+               "servo_cfg_t must match the tail of servo_ctl_t");
 
-typedef struct
-{
-    control_word_t control_word;
-    servo_ctl_t servos;
-    adc_t pots;
-} memmap_t;
+static servo_cfg_t staged_cfg;
 
-static memmap_t memmap;
+static control_word_t control_word;
+static adc_t pots;
+#ifdef SERVO_KEYFRAMES
+static keyframe_queue_t keyframes;
+#endif
+#ifdef SERVO_COMMANDS
+static servo_cmd_t command;
+#endif
+#ifdef ATTENTION_LINE
+static attention_t attention;
+#endif
 
 void i2c_indicate_activity()
 {
@@ -57,9 +75,231 @@ void i2c_indicate_activity()
 
 bool busy_flag = true;
 
+/* Set while a transaction is writing into shadow_servos */
+static volatile bool servos_writing;
+
+/* Channels whose position was written since the last commit */
+static uint8_t servos_written;
+
 bool get_busy_flag()
 {
-    return busy_flag;
+    return busy_flag || servos_writing;
+}
+
+static void servos_on_write(uint16_t offset)
+{
+    servos_writing = true;
+    servos_written |= 1 << (offset / sizeof(uint16_t));
+}
+
+static void servos_on_complete()
+{
+    servos_writing = false;
+}
+
+/**
+ * @brief Copies the staged bands and refresh dividers into shadow_servos.
+ *
+ * @return Bitmask of the channels they changed: all of them for a band
+ * change.
+ */
+static uint8_t servos_apply_cfg()
+{
+    uint8_t changed = 0;
+
+    if(staged_cfg.baseband != shadow_servos.baseband ||
+       staged_cfg.maxband != shadow_servos.maxband)
+        changed = SERVO_DIRTY_ALL;
+
+    for(uint8_t i = 0; i < NUM_SERVOS; i++)
+        if(staged_cfg.refresh_div[i] != shadow_servos.refresh_div[i])
+            changed |= 1 << i;
+
+    memcpy(&shadow_servos.baseband, &staged_cfg, sizeof(staged_cfg));
+    return changed;
+}
+
+/**
+ * @brief Applies a commit once the transaction carrying it has ended. The
+ * staged bands and refresh dividers take effect, and the channels they
+ * changed or whose position was written since the last commit are flagged
+ * for reloading. Runs with interrupts disabled (from the USI interrupt or
+ * i2c_busy()), so the slot interrupts never see a half-copied band.
+ */
+static void control_on_complete()
+{
+    if(control_word.commit == COMMIT_MAGIC_NUMBER)
+    {
+        servo_mark_dirty(servos_written | servos_apply_cfg());
+        servos_written = 0;
+        control_word.commit = 0;
+#ifdef ATTENTION_LINE
+        attention_raise(ATTN_COMMIT);
+#endif
+    }
+}
+
+#ifdef SERVO_COMMANDS
+/**
+ * @brief Runs a command once its op byte has been written.
+ *
+ * This is called from the I2C interrupt, so the read-modify-write cannot
+ * interleave with the main loop or with another transaction. The channels
+ * are reloaded right away, without waiting for a commit.
+ */
+static void command_on_write(uint16_t offset)
+{
+    uint16_t band, value;
+    uint8_t mask, i = command.target;
+
+    if(offset != offsetof(servo_cmd_t, op))
+        return;
+
+    band = sat_sub_u16(shadow_servos.maxband, shadow_servos.baseband);
+    value = lesser(greater_s16(command.value, 0), band);
+
+    if(command.op == SERVO_CMD_SET_MASK)
+        mask = i & SERVO_DIRTY_ALL;
+    else
+        mask = (i < NUM_SERVOS) ? (1 << i) : 0;
+
+    switch(mask ? command.op : SERVO_CMD_ERROR)
+    {
+    case SERVO_CMD_ADD:
+        value = lesser(sat_offset_u16(shadow_servos.pos[i], command.value),
+                       band);
+        // fall through
+    case SERVO_CMD_SET_CLAMP:
+        command.result = shadow_servos.pos[i] = value;
+        break;
+
+    case SERVO_CMD_SWAP:
+        command.result = shadow_servos.pos[i];
+        shadow_servos.pos[i] = command.value;
+        break;
+
+    case SERVO_CMD_SET_MASK:
+        for(i = 0; i < NUM_SERVOS; i++)
+            if(mask & (1 << i))
+                shadow_servos.pos[i] = value;
+        command.result = value;
+        break;
+
+    default:
+        command.op = SERVO_CMD_ERROR;
+        return;
+    }
+
+    command.op = SERVO_CMD_DONE;
+    servo_mark_dirty(mask);
+}
+#endif
+
+/* Laid out as described by memmap_t */
+static const i2c_region_t regions[] =
+{
+    {
+        offsetof(memmap_t, control_word), sizeof(control_word),
+        (uint8_t*)&control_word, I2C_REGION_READ | I2C_REGION_WRITE,
+        0, control_on_complete
+    },
+    {
+        offsetof(memmap_t, servos), sizeof(shadow_servos.pos),
+        (uint8_t*)&shadow_servos, I2C_REGION_READ | I2C_REGION_WRITE,
+        servos_on_write, servos_on_complete
+    },
+    {
+        offsetof(memmap_t, servos.baseband), sizeof(staged_cfg),
+        (uint8_t*)&staged_cfg, I2C_REGION_READ | I2C_REGION_WRITE,
+        0, 0
+    },
+#ifdef SERVO_KEYFRAMES
+    {
+        offsetof(memmap_t, keyframes), sizeof(keyframes),
+        (uint8_t*)&keyframes, I2C_REGION_READ | I2C_REGION_WRITE,
+        0, 0
+    },
+#endif
+#ifdef SERVO_COMMANDS
+    {
+        offsetof(memmap_t, command), sizeof(command),
+        (uint8_t*)&command, I2C_REGION_READ | I2C_REGION_WRITE,
+        command_on_write, 0
+    },
+#endif
+#ifdef ATTENTION_LINE
+    {
+        offsetof(memmap_t, attention), ATTENTION_WRITABLE_LEN,
+        (uint8_t*)&attention, I2C_REGION_READ | I2C_REGION_WRITE,
+        attention_on_write, 0
+    },
+    {
+        offsetof(memmap_t, attention.status),
+        sizeof(attention) - ATTENTION_WRITABLE_LEN,
+        &attention.status, I2C_REGION_READ,
+        0, 0
+    },
+#endif
+    {
+        offsetof(memmap_t, pots), sizeof(pots),
+        (uint8_t*)&pots, I2C_REGION_READ,
+        0, 0
+    },
+};
+
+#define NUM_REGIONS (sizeof(regions) / sizeof(regions[0]))
+
+_Static_assert(NUM_REGIONS <= I2C_MAX_REGIONS,
+               "too many regions for the I2C driver");
+
+/**
+ * @brief Sets up the register map and the modules backing it, and starts the
+ * I2C driver.
+ */
+static void memmap_init()
+{
+    i2c_init_regions(regions, NUM_REGIONS);
+
+    servo_init(&shadow_servos, get_busy_flag);
+    memcpy(&staged_cfg, &shadow_servos.baseband, sizeof(staged_cfg));
+    adc_init(&pots);
+#ifdef SERVO_KEYFRAMES
+    keyframe_init(&keyframes);
+#endif
+#ifdef ATTENTION_LINE
+    attention_init(&attention);
+#endif
+
+    i2c_init_mem(I2C_SLAVE_ADDR);
+}
+
+/**
+ * @brief Runs the main loop's share of the register map handling.
+ *
+ * Called continuously from the main loop. Polling i2c_busy() is what notices
+ * the end of write transactions (and so applies commits).
+ */
+static void memmap_service()
+{
+#ifdef SERVO_KEYFRAMES
+    static uint8_t frame;
+#endif
+
+    i2c_busy();
+    busy_flag = false;
+
+#ifdef SERVO_KEYFRAMES
+    while(frame != servo_frame_count())
+    {
+        bool i2c_idle = !i2c_busy();
+
+        frame++;
+
+        busy_flag = true;
+        servo_mark_dirty(keyframe_step(&shadow_servos, i2c_idle));
+        busy_flag = false;
+    }
+#endif
 }
 
 int main(void) {
@@ -73,15 +313,7 @@ int main(void) {
     INIT_PORT1();
     INIT_PORT2();
 
-    i2c_init_readmem((uint8_t*)&memmap, sizeof(memmap));
-    i2c_init_writemem((uint8_t*)&memmap.control_word,
-                      sizeof(memmap.control_word) + sizeof(memmap.servos));
-
-    servo_init(&shadow_servos, get_busy_flag);
-    memcpy(&memmap.servos, &shadow_servos, sizeof(shadow_servos));
-    adc_init(&memmap.pots);
-
-    i2c_init_mem(0x40);
+    memmap_init();
 
     _BIS_SR(GIE);
 
@@ -95,18 +327,7 @@ int main(void) {
 
         while(counter--)
         {
-            if(!i2c_busy())
-            {
-                busy_flag = true;
-
-                if(memmap.control_word.commit == COMMIT_MAGIC_NUMBER)
-                {
-                    memcpy(&shadow_servos, &memmap.servos, sizeof(memmap.servos));
-                    memmap.control_word.commit = 0;
-                }
-
-                busy_flag = false;
-            }
+            memmap_service();
         }
 
         P1OUT ^= 0x01;
@@ -114,4 +335,3 @@ int main(void) {
 
     return 0;
 }
-
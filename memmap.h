@@ -0,0 +1,131 @@
+/*
+ * memmap.h
+ *
+ * Copyright (C) 2016-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * Layout of the register map the master sees over I2C. Kept free of MSP430
+ * specifics so host-side code can include it.
+ */
+
+#ifndef MEMMAP_H
+#define MEMMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "adc.h"
+#include "attention.h"
+#include "keyframe.h"
+#include "servo.h"
+
+#define I2C_SLAVE_ADDR (0x40)
+
+#define COMMIT_MAGIC_NUMBER (0b101)
+
+typedef struct
+{
+    uint8_t commit : 3;
+    uint8_t pad : 5;
+    uint8_t pad2;
+} control_word_t;
+
+/*
+ * Uncomment this to map the command block below. It takes 6 bytes of RAM and
+ * a region table entry, and only saves bus traffic for masters that make
+ * relative moves or need the previous position.
+ */
+//#define SERVO_COMMANDS
+
+/*
+ * Command block: operations on the setpoints that run on the device, so a
+ * relative move or a fetch-and-update needs no read before the write. The
+ * master writes value, target and op in one burst; the command runs when the
+ * op byte arrives, inside the I2C interrupt, so nothing else can touch the
+ * positions in between. op then reads back as SERVO_CMD_DONE or
+ * SERVO_CMD_ERROR, followed by the result, e.g. in the same transaction:
+ *
+ *   W[cmd, value lo, value hi, target, op] Sr W[cmd.op] Sr R[status, result]
+ *
+ * Writing only the op byte repeats the last command.
+ */
+#define SERVO_CMD_DONE (0x00)
+/* pos[target] += value, saturating and clamped to the band; result = new pos */
+#define SERVO_CMD_ADD (0x01)
+/* pos[target] = value clamped to the band; result = new pos */
+#define SERVO_CMD_SET_CLAMP (0x02)
+/* pos[target] = value, as a plain write would; result = previous pos */
+#define SERVO_CMD_SWAP (0x03)
+/* pos[i] = value clamped to the band for each bit i of target; result = pos */
+#define SERVO_CMD_SET_MASK (0x04)
+/* Unknown op, or target out of range; nothing was changed */
+#define SERVO_CMD_ERROR (0xFF)
+
+typedef struct
+{
+    int16_t value;
+    uint8_t target;
+    uint8_t op;
+    uint16_t result;
+} servo_cmd_t;
+
+/*
+ * Layout of the register map as the master sees it. There is no instance of
+ * this on the device: main.c maps each member onto the structure that owns it
+ * through the I2C driver's region table. Members must not leave padding
+ * between them, since the gaps would not be mapped.
+ *
+ * Positions are written in place: a channel picks up a new position at its
+ * next reload, which the commit (or a command, or a keyframe) requests. The
+ * bands and refresh dividers are staged and only take effect on commit.
+ */
+typedef struct
+{
+    control_word_t control_word;
+    servo_ctl_t servos;
+#ifdef SERVO_KEYFRAMES
+    keyframe_queue_t keyframes;
+#endif
+#ifdef SERVO_COMMANDS
+    servo_cmd_t command;
+#endif
+#ifdef ATTENTION_LINE
+    attention_t attention;
+#endif
+    adc_t pots;
+} memmap_t;
+
+_Static_assert(sizeof(memmap_t) ==
+               sizeof(control_word_t) + sizeof(servo_ctl_t) +
+#ifdef SERVO_KEYFRAMES
+               sizeof(keyframe_queue_t) +
+#endif
+#ifdef SERVO_COMMANDS
+               sizeof(servo_cmd_t) +
+#endif
+#ifdef ATTENTION_LINE
+               sizeof(attention_t) +
+#endif
+               sizeof(adc_t),
+               "memmap_t has padding, which would not be mapped");
+
+/* Registers below this offset are writable; the rest are read-only */
+#define MEMMAP_WRITABLE_LEN (offsetof(memmap_t, pots))
+
+#endif // MEMMAP_H
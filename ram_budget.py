@@ -0,0 +1,296 @@
+#!/usr/bin/python
+
+"""
+Static RAM and worst-case stack report for the firmware image.
+
+Static RAM comes from the symbol tables of the objects (per module) and the
+section sizes of the linked image (total). Stack depth comes from the
+-fstack-usage output of each object and a call graph recovered from the
+disassembly; an indirect call is assumed to reach any function whose address
+is taken (an immediate operand, or a word in the initialized data). Interrupt
+handlers are found through the vector table. The handlers only re-enable GIE
+on return, so by default one handler at a time is assumed on top of main;
+--nesting adds them all up, for handlers that re-enable GIE early.
+
+The build runs it by default (ram_budget.txt), so an image that does not fit
+fails the build.
+
+Exits with a non-zero status if static RAM plus worst-case stack does not fit
+in RAM minus the margin.
+"""
+
+import argparse, os, re, subprocess, sys
+
+RETURN_ADDRESS = 2
+INTERRUPT_FRAME = 4  # PC and SR pushed by the hardware
+RESET_VECTOR = -1    # index of the reset vector in the vector table
+
+def run(cmd, stderr=None):
+    return subprocess.check_output(cmd, stderr=stderr, universal_newlines=True)
+
+def subst_ext(fname, ext):
+    return os.path.splitext(fname)[0] + ext
+
+def static_ram(nm, fname):
+    """Returns {symbol: size} for the data, bss and common symbols defined in
+    fname."""
+    syms = {}
+    for line in run([nm, "-S", "--defined-only", fname]).splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in "bBCdD":
+            syms[fields[3]] = int(fields[1], 16)
+    return syms
+
+def image_ram(size, elf):
+    total = 0
+    for line in run([size, "-A", elf]).splitlines():
+        fields = line.split()
+        if fields and fields[0] in (".data", ".bss", ".noinit"):
+            total += int(fields[1])
+    return total
+
+def stack_frames(objects):
+    """Parses the .su files next to the objects into {function: (bytes, kind)}."""
+    frames = {}
+    for obj in objects:
+        su = subst_ext(obj, ".su")
+        if not os.path.exists(su):
+            continue
+        with open(su) as f:
+            for line in f:
+                loc, size, kind = line.rstrip("\n").split("\t")
+                func = loc.split(":")[-1]
+                size = int(size)
+                if func not in frames or frames[func][0] < size:
+                    frames[func] = (size, kind)
+    return frames
+
+def call_graph(objdump, elf):
+    """Returns ({function: set(callees)}, set(functions with indirect calls),
+    {address: function}, set(functions whose address is taken in code))."""
+    func_re = re.compile(r"^([0-9a-f]+) <([^>]+)>:")
+    call_re = re.compile(r"\t(call|calla|br|bra|jmp)\s+(\S+)(.*)$")
+    imm_re = re.compile(r"#(-?0x[0-9a-f]+|-?[0-9]+)\b")
+    addrs = {}
+    calls = {}
+    indirect = set()
+    taken = set()
+    current = None
+
+    disasm = run([objdump, "-d", elf]).splitlines()
+    for line in disasm:
+        m = func_re.match(line)
+        if m:
+            addrs[int(m.group(1), 16)] = m.group(2)
+    funcs = set(addrs.values())
+
+    for line in disasm:
+        m = func_re.match(line)
+        if m:
+            current = m.group(2)
+            calls.setdefault(current, set())
+            continue
+        m = call_re.search(line)
+        if not m:
+            # Loading a function's address, e.g. to store a callback
+            for imm in imm_re.finditer(line):
+                func = addrs.get(int(imm.group(1), 0) & 0xFFFF)
+                if func:
+                    taken.add(func)
+        if not m or current is None:
+            continue
+        op, target, rest = m.groups()
+        sym = re.search(r"<([^>+]+)>", rest)
+        if re.match(r"#?(0x)?[0-9a-f]+$", target):
+            callee = addrs.get(int(target.lstrip("#"), 16))
+        elif sym and sym.group(1) in funcs:
+            callee = sym.group(1)
+        else:
+            # Register or memory indirect (e.g. through a function pointer)
+            if op.startswith("call") or sym:
+                indirect.add(current)
+            continue
+        # Branches only resolve when they land on a function (tail calls)
+        if callee and callee != current:
+            calls[current].add(callee)
+    return calls, indirect, addrs, taken
+
+def section_words(objdump, elf, sections):
+    """Returns the little-endian words of the sections, in order. Missing
+    sections are skipped."""
+    words = []
+    for section in sections:
+        try:
+            with open(os.devnull, "w") as devnull:
+                dump = run([objdump, "-s", "-j", section, elf], stderr=devnull)
+        except subprocess.CalledProcessError:
+            continue
+        for line in dump.splitlines():
+            m = re.match(r"^ [0-9a-f]+ ((?:[0-9a-f]+ ?)+)", line)
+            if not m:
+                continue
+            data = "".join(m.group(1).split())
+            for i in range(0, len(data) - 3, 4):
+                words.append(int(data[i + 2:i + 4] + data[i:i + 2], 16))
+    return words
+
+def data_pointers(objdump, elf, addrs):
+    """Returns the functions whose address is stored in initialized data
+    (callback tables and the like)."""
+    return set(addrs[w] for w in section_words(objdump, elf,
+                                               (".rodata", ".data"))
+               if w in addrs)
+
+def vector_handlers(objdump, elf, addrs):
+    """Returns the functions listed in the vector table, except reset."""
+    words = section_words(objdump, elf, (".vectors",))
+    if not words:
+        return []
+    del words[RESET_VECTOR]
+    handlers = []
+    for w in words:
+        func = addrs.get(w)
+        if func and func not in handlers:
+            handlers.append(func)
+    return handlers
+
+class StackAnalysis:
+    def __init__(self, frames, calls, indirect, unknown_frame):
+        self.frames = frames
+        self.calls = calls
+        self.indirect = indirect
+        self.unknown_frame = unknown_frame
+        self.indirect_cost = 0
+        self.unknown = set()
+        self.recursive = set()
+
+    def frame(self, func):
+        if func in self.frames:
+            return self.frames[func][0]
+        self.unknown.add(func)
+        return self.unknown_frame
+
+    def depth(self, func, path=()):
+        """Worst-case bytes of stack used by func and everything it calls."""
+        if func in path:
+            self.recursive.add(func)
+            return 0
+        path = path + (func,)
+        worst = 0
+        for callee in self.calls.get(func, ()):
+            worst = max(worst, RETURN_ADDRESS + self.depth(callee, path))
+        if func in self.indirect:
+            worst = max(worst, RETURN_ADDRESS + self.indirect_cost)
+        return self.frame(func) + worst
+
+    def resolve_indirect(self, targets, exclude):
+        """Assumes an indirect call can reach any of targets except the
+        roots. Targets that make indirect calls themselves are not followed
+        into; returns them."""
+        targets = [f for f in targets if f not in exclude]
+        self.indirect_cost = max([0] + [self.depth(f) for f in targets
+                                        if f not in self.indirect])
+        return sorted(f for f in targets if f in self.indirect)
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument("--ram", type=int, required=True,
+                    help="RAM size of the part, in bytes")
+    ap.add_argument("--margin", type=int, default=0,
+                    help="bytes to keep free")
+    ap.add_argument("--prefix", default="msp430-",
+                    help="toolchain prefix for nm, size and objdump")
+    ap.add_argument("--entry", default="main")
+    ap.add_argument("--isr", action="append", default=[],
+                    help="treat a function as an interrupt handler (in "
+                         "addition to the vector table)")
+    ap.add_argument("--nesting", action="store_true",
+                    help="assume every interrupt handler can preempt main and "
+                         "every other handler once")
+    ap.add_argument("--unknown-frame", type=int, default=16,
+                    help="frame size assumed for functions without stack "
+                         "usage information (e.g. libgcc)")
+    ap.add_argument("-o", "--output")
+    ap.add_argument("elf")
+    ap.add_argument("objects", nargs="*")
+    args = ap.parse_args()
+
+    nm = args.prefix + "nm"
+    size = args.prefix + "size"
+    objdump = args.prefix + "objdump"
+
+    out = []
+
+    out.append("Static RAM by module:")
+    for obj in args.objects:
+        syms = static_ram(nm, obj)
+        out.append("  %-24s %5d" % (obj, sum(syms.values())))
+        for name, n in sorted(syms.items(), key=lambda x: -x[1]):
+            out.append("    %-22s %5d" % (name, n))
+    static = image_ram(size, args.elf)
+    out.append("  %-24s %5d" % ("total (linked)", static))
+
+    frames = stack_frames(args.objects)
+    calls, indirect, addrs, taken = call_graph(objdump, args.elf)
+    taken |= data_pointers(objdump, args.elf, addrs)
+    isrs = vector_handlers(objdump, args.elf, addrs)
+    isrs += [f for f in args.isr if f not in isrs]
+
+    if indirect and not taken:
+        # Nothing recognized as a target; fall back to every function
+        taken = set(calls)
+    sa = StackAnalysis(frames, calls, indirect, args.unknown_frame)
+    unfollowed = sa.resolve_indirect(taken, set(isrs) | set([args.entry]))
+
+    out.append("")
+    out.append("Worst-case stack:")
+    main_depth = sa.depth(args.entry)
+    out.append("  %-24s %5d" % (args.entry, main_depth))
+    isr_depths = []
+    for isr in isrs:
+        d = INTERRUPT_FRAME + sa.depth(isr)
+        isr_depths.append(d)
+        out.append("  %-24s %5d" % (isr, d))
+    if args.nesting:
+        stack = main_depth + sum(isr_depths)
+        out.append("  %-24s %5d" % ("total (all nested)", stack))
+    else:
+        stack = main_depth + max([0] + isr_depths)
+        out.append("  %-24s %5d" % ("total (no nesting)", stack))
+
+    for func in sorted(f for f in frames if frames[f][1] != "static"):
+        out.append("warning: %s has a %s frame" % (func, frames[func][1]))
+    for func in sorted(sa.unknown):
+        out.append("warning: no stack usage for %s, assumed %d bytes" %
+                   (func, args.unknown_frame))
+    for func in sorted(indirect):
+        out.append("warning: %s makes indirect calls, assumed %d bytes" %
+                   (func, sa.indirect_cost))
+    for func in unfollowed:
+        out.append("warning: indirect call target %s makes indirect calls "
+                   "itself, not followed" % func)
+    for func in sorted(sa.recursive):
+        out.append("warning: %s is recursive, depth is not bounded" % func)
+
+    budget = args.ram - args.margin
+    used = static + stack
+    out.append("")
+    out.append("RAM: %d static + %d stack = %d of %d bytes (%d margin)" %
+               (static, stack, used, args.ram, args.margin))
+
+    report = "\n".join(out) + "\n"
+    sys.stdout.write(report)
+
+    if used > budget or sa.recursive:
+        sys.stderr.write("error: RAM budget exceeded by %d bytes\n" %
+                         (used - budget) if used > budget else
+                         "error: recursion makes the stack depth unbounded\n")
+        return 1
+
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(report)
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
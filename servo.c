@@ -25,57 +25,291 @@
 #include "servo.h"
 
 #include <msp430.h>
-#include <string.h>
 
+#include "adc.h"
+#include "global_const.h"
 #include "simple_io.h"
+#include "simple_math.h"
 
 #define PWM_FREQUENCY (50)
 #define TIMER_A_DIVIDER (32)
 
-const uint8_t PWM_PINS[] = { 1, 2 };
+#define ADC_SYNC_PHASE_CLK_TIME (((CLOCK_SPEED/1000000ul) * ADC_SYNC_PHASE_US) / \
+                                 (TIMER_A_DIVIDER))
+
+#ifdef SERVO_HW_PULSE
+#ifdef ADC_SYNC_TO_FRAME
+#error "SERVO_HW_PULSE and ADC_SYNC_TO_FRAME both need TA0.1"
+#endif
+#if SERVO_LANES > 1
+#error "SERVO_HW_PULSE only drives a single lane"
+#endif
+
+#define PWM_OUT_PIN (2)         // TA0.1
+#define SERVO_DEMUX_BITS (1)
+const uint8_t SERVO_DEMUX_PINS[SERVO_DEMUX_BITS] = { 1 };
+
+#if NUM_SERVOS > (1 << SERVO_DEMUX_BITS)
+#error "Not enough demultiplexer select lines for NUM_SERVOS"
+#endif
+#elif SERVO_LANES > 1
+// P1.1, P1.2 and P2.0 to P2.5, in channel order
+const uint8_t PWM_PINS[NUM_SERVOS] = { 1, 8, 9, 10, 2, 11, 12, 13 };
+/*
+ * The same pins as port bits, P2 in the high byte. The MSP430 shifts one bit
+ * per instruction, so the ISRs look these up instead of shifting.
+ */
+static const uint16_t PWM_MASKS[NUM_SERVOS] =
+    { 0x0002, 0x0100, 0x0200, 0x0400, 0x0004, 0x0800, 0x1000, 0x2000 };
+#define PWM_OUT_SET(mask) (P1OUT |= (mask) & 0xFF, P2OUT |= (mask) >> 8)
+#define PWM_OUT_CLEAR(mask) (P1OUT &= ~((mask) & 0xFF), P2OUT &= ~((mask) >> 8))
+#else
+const uint8_t PWM_PINS[NUM_SERVOS] = { 1, 2 };
+static const uint16_t PWM_MASKS[NUM_SERVOS] = { 0x0002, 0x0004 };
+// All on P1
+#define PWM_OUT_SET(mask) (P1OUT |= (mask))
+#define PWM_OUT_CLEAR(mask) (P1OUT &= ~(mask))
+#endif
 #define DEFAULT_CENTER_POS (DEFAULT_MAXBAND_CLK_TIME_DIFF/2)
 
 static servo_ctl_t* servo_ctl;
-static servo_ctl_t servo_ctl_buffer;
 
-static uint8_t current_servo;
+/*
+ * Per-channel values derived from the control structure. These are only
+ * recomputed when the channel is marked dirty, so the slot ISR normally just
+ * loads the precomputed compare value.
+ */
+static uint16_t servo_compare[NUM_SERVOS];
+static uint8_t servo_refresh_skip[NUM_SERVOS];
+static uint8_t servo_refresh_count[NUM_SERVOS];
+static volatile uint8_t servo_dirty;
+/*
+ * Width of the position range, maxband - baseband (0 for inverted bands).
+ * Bands only change with every channel marked dirty, so it is recomputed
+ * then rather than on each load.
+ */
+static uint16_t servo_span;
+
+/* The compare register that times the end of each lane's pulses */
+static volatile uint16_t* const servo_lane_ccr[SERVO_LANES] =
+{
+    &TA0CCR1,
+#if SERVO_CCRS > 1
+    &TA0CCR2,
+#endif
+#if SERVO_TIMERS > 1
+    &TA1CCR1,
+#if SERVO_CCRS > 1
+    &TA1CCR2,
+#endif
+#endif
+};
+
+#if SERVO_LANES > 1
+static volatile uint16_t* const servo_lane_cctl[SERVO_LANES] =
+{
+    &TA0CCTL1,
+#if SERVO_CCRS > 1
+    &TA0CCTL2,
+#endif
+#if SERVO_TIMERS > 1
+    &TA1CCTL1,
+#if SERVO_CCRS > 1
+    &TA1CCTL2,
+#endif
+#endif
+};
+#endif
+
+static uint8_t current_slot;
+/* Bits of the channels in current_slot, kept in step to avoid shifting */
+static uint8_t current_slot_mask;
 static uint16_t norm_period, last_period;
+#ifdef ADC_SYNC_TO_FRAME
+/* Latest pulse end of the current slot, across its lanes */
+static uint16_t slot_last_end;
+#endif
+static volatile uint8_t servo_frames;
 
 static bool(*servo_ctl_busy)();
 
-static uint16_t current_servo_pos;
+/**
+ * @brief Recomputes the position range from the bands. Inverted bands
+ * (maxband < baseband) collapse the range to the baseband instead of
+ * wrapping.
+ */
+static void servo_load_span()
+{
+    servo_span = sat_sub_u16(servo_ctl->maxband, servo_ctl->baseband);
+}
+
+/**
+ * @brief Recomputes the derived values for a channel from the control
+ * structure.
+ *
+ * @param servo The channel to reload.
+ */
+static void servo_load(uint8_t servo)
+{
+    uint8_t div = servo_ctl->refresh_div[servo];
+
+    // Clamp servo position; baseband + servo_span cannot overflow
+    uint16_t pos = lesser(servo_ctl->pos[servo], servo_span);
+
+    servo_compare[servo] = servo_ctl->baseband + pos;
+#ifdef SERVO_HW_PULSE
+    /*
+     * The output unit raises the pulse on EQU0, one tick before the count
+     * restarts, so the pulse is one tick longer than the compare value.
+     */
+    servo_compare[servo] = sat_sub_u16(servo_compare[servo], 1);
+#endif
+    servo_refresh_skip[servo] = (div) ? (div - 1) : 0;
+}
+
+/**
+ * @brief Determines whether a channel gets a pulse in the current frame.
+ *
+ * @param servo The channel whose slot is starting.
+ *
+ * @return Whether or not the channel should be pulsed.
+ */
+static bool servo_slot_active(uint8_t servo)
+{
+    if(servo_refresh_count[servo])
+    {
+        servo_refresh_count[servo]--;
+        return false;
+    }
+
+    servo_refresh_count[servo] = servo_refresh_skip[servo];
+    return true;
+}
+
+#ifdef SERVO_HW_PULSE
+/**
+ * @brief Prepares the output for the next slot: routes TA0.1 to the channel
+ * through the demultiplexer and decides whether the slot gets a pulse. Must
+ * run between the end of one pulse and the start of the next slot, since the
+ * output unit raises the pulse by itself when the slot starts.
+ *
+ * @param servo The channel whose slot is next.
+ */
+static void servo_prepare_slot(uint8_t servo)
+{
+    for(uint8_t i = 0; i < SERVO_DEMUX_BITS; i++)
+    {
+        if(servo & (1 << i))
+            set_pin(SERVO_DEMUX_PINS[i]);
+        else
+            clear_pin(SERVO_DEMUX_PINS[i]);
+    }
+
+    /* Reset/set pulses; reset alone keeps the output low through the slot */
+    TA0CCTL1 = (TA0CCTL1 & ~OUTMOD_7) |
+               (servo_slot_active(servo) ? OUTMOD_7 : OUTMOD_5);
+}
+#endif
+
+/**
+ * @brief Marks channels whose control values have changed.
+ *
+ * The slot ISR only re-reads a channel's position, the bands and the refresh
+ * divisor from the control structure after the channel has been marked dirty
+ * here. Call this after updating the control structure (while the busy query
+ * passed to servo_init still reports busy, or after it has been released).
+ * The position range is derived from the bands here, and only when every
+ * channel is marked, so mark SERVO_DIRTY_ALL after changing them.
+ *
+ * @param mask Bitmask of channels to reload, or SERVO_DIRTY_ALL.
+ */
+void servo_mark_dirty(uint8_t mask)
+{
+    if(mask == SERVO_DIRTY_ALL)
+        servo_load_span();
+    servo_dirty |= mask;
+}
+
+/**
+ * @brief Gets the number of frames started so far.
+ *
+ * @return The frame counter, wrapping at 256.
+ */
+uint8_t servo_frame_count()
+{
+    return servo_frames;
+}
 
 void servo_init(servo_ctl_t* control, bool(*ctl_busy)())
 {
     servo_ctl = control;
     servo_ctl_busy = ctl_busy;
 
-    norm_period = PWM_PERIOD / NUM_SERVOS;
-    last_period = PWM_PERIOD - (((uint32_t)norm_period) * (NUM_SERVOS - 1));
+    norm_period = PWM_PERIOD / SERVO_SLOTS;
+    last_period = PWM_PERIOD - (((uint32_t)norm_period) * (SERVO_SLOTS - 1));
 
     // Timer counts for 0
     norm_period--;
     last_period--;
-    current_servo = 0;
+    current_slot = 0;
+    current_slot_mask = (1u << SERVO_LANES) - 1;
 
     TA0CTL |= TACLR;
     TA0CTL = TASSEL_2 | ID_2;
     TA0CCTL1 |= CCIE;
+#if SERVO_CCRS > 1
+    TA0CCTL2 |= CCIE;
+#endif
     TA0CCTL0 |= CCIE;
+#ifdef SERVO_HW_PULSE
+    // No pulse until the first slot has been prepared
+    TA0CCTL1 |= OUTMOD_5;
+    P1SEL |= 1 << PWM_OUT_PIN;
+    set_pin_output(PWM_OUT_PIN);
+    for (uint8_t i = 0; i < SERVO_DEMUX_BITS; i++)
+        set_pin_output(SERVO_DEMUX_PINS[i]);
+#endif
     TA0CCR0 = norm_period;
-    TA0CCR1 = DEFAULT_CENTER_POS;
 
-    servo_ctl_buffer.baseband = DEFAULT_BASEBAND_CLK_TIME;
-    servo_ctl_buffer.maxband = DEFAULT_MAXBAND_CLK_TIME;
+#if SERVO_TIMERS > 1
+    // TA1 only times pulse ends; TA0's CCR0 interrupt starts every slot
+    TA1CTL |= TACLR;
+    TA1CTL = TASSEL_2 | ID_2;
+    TA1CCTL1 |= CCIE;
+#if SERVO_CCRS > 1
+    TA1CCTL2 |= CCIE;
+#endif
+    TA1CCR0 = norm_period;
+#endif
+
+    for (uint8_t lane = 0; lane < SERVO_LANES; lane++)
+        *servo_lane_ccr[lane] = DEFAULT_CENTER_POS;
+
+    control->baseband = DEFAULT_BASEBAND_CLK_TIME;
+    control->maxband = DEFAULT_MAXBAND_CLK_TIME;
+    servo_load_span();
 
     for (uint8_t i = 0; i < NUM_SERVOS; i++) {
+#ifndef SERVO_HW_PULSE
         set_pin_output(PWM_PINS[i]);
-        servo_ctl_buffer.pos[i] = DEFAULT_CENTER_POS;
+#endif
+        control->pos[i] = DEFAULT_CENTER_POS;
+        control->refresh_div[i] = 1;
+
+        servo_load(i);
+        servo_refresh_count[i] = 0;
     }
 
-    memcpy(control, &servo_ctl_buffer, sizeof(servo_ctl_t));
+    servo_dirty = 0;
 
+    /*
+     * TA1 starts a few CPU cycles after TA0, which keeps it well within one
+     * timer tick of TA0 from then on.
+     */
     TA0CTL |= MC_1;
+#if SERVO_TIMERS > 1
+    TA1CTL |= MC_1;
+#endif
 }
 
 __attribute__((__interrupt__(TIMER0_A0_VECTOR)))
@@ -83,40 +317,101 @@ void ISR_timer0_a0()
 {
     _BIC_SR(GIE);
 
-    current_servo++;
-    if(current_servo == NUM_SERVOS)
+    current_slot++;
+    current_slot_mask <<= SERVO_LANES;
+    if(current_slot == SERVO_SLOTS)
     {
-        current_servo = 0;
+        current_slot = 0;
+        current_slot_mask = (1u << SERVO_LANES) - 1;
+        servo_frames++;
+#ifdef ATTENTION_LINE
+        servo_indicate_frame();
+#endif
     }
 
-    set_pin(PWM_PINS[current_servo]);
+    uint8_t first = current_slot * SERVO_LANES;
+
+#ifndef SERVO_HW_PULSE
+    // Raise the pulses of all lanes with one write per port
+    uint16_t rise = 0;
+    for(uint8_t lane = 0; lane < SERVO_LANES; lane++)
+        if(servo_slot_active(first + lane))
+            rise |= PWM_MASKS[first + lane];
+    PWM_OUT_SET(rise);
+#endif
 
     /*
-     * If the control structure is not locked, go ahead and access it
-     * (Also access if there was no busy query function specified)
+     * If a channel changed and the control structure is not locked, go ahead
+     * and access it (Also access if there was no busy query function specified)
      */
-    if(!servo_ctl_busy || !servo_ctl_busy())
-    {
-        current_servo_pos = servo_ctl->pos[current_servo];
-        servo_ctl_buffer.pos[current_servo] = current_servo_pos;
-        memcpy(&servo_ctl_buffer.baseband, &servo_ctl->baseband, 4);
-    }
-    else
+    uint8_t dirty = servo_dirty & current_slot_mask;
+    if(dirty && (!servo_ctl_busy || !servo_ctl_busy()))
     {
-        current_servo_pos = servo_ctl_buffer.pos[current_servo];
+        // Walk up from the slot's lowest channel bit
+        uint8_t bit = current_slot_mask & -current_slot_mask;
+        for(uint8_t lane = 0; lane < SERVO_LANES; lane++, bit <<= 1)
+            if(dirty & bit)
+                servo_load(first + lane);
+        servo_dirty &= ~dirty;
     }
 
-    // Clamp servo position
-    uint16_t maxband_diff = servo_ctl_buffer.maxband -
-                            servo_ctl_buffer.baseband;
-    if(current_servo_pos > maxband_diff)
-        current_servo_pos = maxband_diff;
+#ifdef ADC_SYNC_TO_FRAME
+    // Drop TA0.1 (the ADC trigger) so the next trigger is a rising edge
+    TA0CCTL1 &= ~OUTMOD_7;
+#endif
+
+    for(uint8_t lane = 0; lane < SERVO_LANES; lane++)
+        *servo_lane_ccr[lane] = servo_compare[first + lane];
 
-    TA0CCR1 = servo_ctl_buffer.baseband + current_servo_pos;
+#ifdef ADC_SYNC_TO_FRAME
+    slot_last_end = servo_compare[first];
+    for(uint8_t lane = 1; lane < SERVO_LANES; lane++)
+        slot_last_end = greater(slot_last_end, servo_compare[first + lane]);
+#endif
 
     _BIS_SR_IRQ(GIE);
 }
 
+/**
+ * @brief Ends the pulse of a lane in the current slot.
+ *
+ * Pulses in the same slot often end on the same tick (e.g. centered servos),
+ * so this also ends the pulses of any other lanes whose compare has matched,
+ * instead of leaving each to its own interrupt. Lane 0 keeps its flag, since
+ * its handler also does the slot bookkeeping.
+ *
+ * @param lane The lane whose compare register matched.
+ */
+static void servo_pulse_end(uint8_t lane)
+{
+#ifdef SERVO_HW_PULSE
+    (void)lane;
+
+    // The output unit has ended the pulse; set up the next slot
+    servo_prepare_slot((current_slot == SERVO_SLOTS - 1) ?
+                       0 : current_slot + 1);
+#else
+    uint8_t first = current_slot * SERVO_LANES;
+    uint16_t fall = PWM_MASKS[first + lane];
+
+#if SERVO_LANES > 1
+    if(*servo_lane_cctl[0] & CCIFG)
+        fall |= PWM_MASKS[first];
+
+    for(uint8_t other = 1; other < SERVO_LANES; other++)
+    {
+        if(*servo_lane_cctl[other] & CCIFG)
+        {
+            *servo_lane_cctl[other] &= ~CCIFG;
+            fall |= PWM_MASKS[first + other];
+        }
+    }
+#endif
+
+    PWM_OUT_CLEAR(fall);
+#endif
+}
+
 __attribute__((__interrupt__(TIMER0_A1_VECTOR)))
 static void ISR_timer0_a1() {
     _BIC_SR(GIE);
@@ -124,15 +419,69 @@ static void ISR_timer0_a1() {
     switch(TAIV)
     {
         case 0x02:
-            clear_pin(PWM_PINS[current_servo]);
+#ifdef ADC_SYNC_TO_FRAME
+            // This match was the ADC trigger, not a pulse edge
+            if((TA0CCTL1 & OUTMOD_7) == OUTMOD_1)
+                break;
+#endif
+
+            servo_pulse_end(0);
 
-            if(current_servo == 0)
+            if(current_slot == 0)
             {
                 TA0CCR0 = last_period;
             } else {
                 TA0CCR0 = norm_period;
             }
+#if SERVO_TIMERS > 1
+            TA1CCR0 = TA0CCR0;
+#endif
+
+#ifdef ADC_SYNC_TO_FRAME
+            /*
+             * After the last pulse of the frame, reuse CCR1 to raise TA0.1
+             * once the phase delay has passed; the rising edge starts the ADC
+             * scan in hardware. The delay counts from the latest pulse end of
+             * the slot, which may be on another lane than this one.
+             */
+            if(current_slot == SERVO_SLOTS - 1)
+            {
+                TA0CCR1 = slot_last_end + ADC_SYNC_PHASE_CLK_TIME;
+                TA0CCTL1 |= OUTMOD_1;
+            }
+#endif
+            break;
+
+#if SERVO_CCRS > 1
+        case 0x04:
+            servo_pulse_end(1);
+            break;
+#endif
+
+        default:
+
+            break;
+    }
+
+    _BIS_SR_IRQ(GIE);
+}
+
+#if SERVO_TIMERS > 1
+__attribute__((__interrupt__(TIMER1_A1_VECTOR)))
+static void ISR_timer1_a1() {
+    _BIC_SR(GIE);
+
+    switch(TA1IV)
+    {
+        case 0x02:
+            servo_pulse_end(SERVO_CCRS);
+            break;
+
+#if SERVO_CCRS > 1
+        case 0x04:
+            servo_pulse_end(SERVO_CCRS + 1);
             break;
+#endif
 
         default:
 
@@ -141,3 +490,4 @@ static void ISR_timer0_a1() {
 
     _BIS_SR_IRQ(GIE);
 }
+#endif
@@ -28,6 +28,19 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+/*
+ * Uncomment this to generate the pulse edges in hardware instead of from the
+ * slot ISRs. TA0.1 runs in reset/set mode on P1.2 and an external
+ * demultiplexer, addressed by the SERVO_DEMUX_PINS select lines, routes it to
+ * the channel whose slot is next; the select lines only change after the
+ * previous pulse has ended. Edge timing then does not depend on interrupt
+ * latency or load. (TA0.1 is only brought out on P1.2 and P1.6, the latter
+ * being SCL, so fanning out by switching pin functions is not an option.)
+ *
+ * This uses TA0.1, so it can't be combined with ADC_SYNC_TO_FRAME.
+ */
+//#define SERVO_HW_PULSE
+
 /*-----Period, in TACLK cycles-----*/
 #define PWM_PERIOD (CLOCK_SPEED / (PWM_FREQUENCY * TIMER_A_DIVIDER))
 
@@ -40,14 +53,55 @@
                                  (TIMER_A_DIVIDER))
 
 #define DEFAULT_MAXBAND_CLK_TIME_DIFF (DEFAULT_MAXBAND_CLK_TIME - DEFAULT_BASEBAND_CLK_TIME)
-#define NUM_SERVOS (2)
+
+/*
+ * The G2x53 parts (8 channels) drive channels from CCR1 and CCR2 of both TA0
+ * and TA1 instead of CCR1 of TA0 alone; the part selects this backend. Those
+ * parts have USCI instead of USI, which the I2C driver does not support, so
+ * the firmware does not build for them and the backend only runs in the host
+ * tools (e.g. servosim with MCU=msp430g2553).
+ */
+#if defined(__MSP430G2553__) || defined(__MSP430G2453__) || \
+    defined(__MSP430G2353__) || defined(__MSP430G2253__) || \
+    defined(__MSP430G2153__)
+#define SERVO_MULTI_TIMER
+#endif
+
+/*
+ * Channels are time-multiplexed over SERVO_SLOTS slots per frame on each
+ * compare unit used ("lane"). Channel n is in slot n / SERVO_LANES of lane
+ * n % SERVO_LANES. CCR0 sets the slot period, and all timers run in step.
+ */
+#ifdef SERVO_MULTI_TIMER
+#define SERVO_TIMERS (2)
+#define SERVO_CCRS (2)
+#else
+#define SERVO_TIMERS (1)
+#define SERVO_CCRS (1)
+#endif
+
+#define SERVO_SLOTS (2)
+#define SERVO_LANES (SERVO_TIMERS * SERVO_CCRS)
+#define NUM_SERVOS (SERVO_LANES * SERVO_SLOTS)
+
+#define SERVO_DIRTY_ALL ((1u << NUM_SERVOS) - 1)
 
 typedef struct
 {
     uint16_t pos[NUM_SERVOS];
     uint16_t baseband, maxband;
+    /*
+     * Pulse each channel once every refresh_div frames (0 and 1 both mean
+     * every frame), e.g. 2 refreshes a holding servo at 25Hz.
+     */
+    uint8_t refresh_div[NUM_SERVOS];
 } servo_ctl_t;
 
 void servo_init(servo_ctl_t* control, bool(*ctl_ready)());
+void servo_mark_dirty(uint8_t mask);
+uint8_t servo_frame_count();
+
+/* Called from the timer interrupt at the start of every frame (attention.c) */
+void servo_indicate_frame();
 
 #endif // SERVO_H
@@ -56,6 +56,11 @@
 #define set_pin_input(pin)                       \
         P1DIR &= ~(1<<pin)&0xFF                 ,\
         P2DIR &= ~(((1<<pin)&0xFF00)>>8)        // Set PORT1 pin to be a digital input
+#define assert_pin_open_drain(pin)               \
+        clear_pin(pin)                          ,\
+        set_pin_output(pin)                     // Pull an open-drain line low
+#define release_pin_open_drain(pin)              \
+        set_pin_input(pin)                      // Let an open-drain line float high
 #define set_pin_analog_input(pin)                \
         ADC10AE0 |= 1<<pin                      ,\
         P1DIR &= ~(1<<pin)                      // Set PORT1 pin to be an ADC10 analog input
@@ -0,0 +1,149 @@
+/*
+ * simple_math.c
+ *
+ * Copyright (C) 2012-2017  Kevin Balke
+ *
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#include "simple_math.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Divides the 32-bit value hi:lo by den.
+ *
+ * @param hi The upper word of the dividend; must be less than den. Receives
+ * the remainder.
+ * @param lo The lower word of the dividend.
+ * @param den The divisor.
+ *
+ * @return The 16-bit quotient.
+ */
+static uint16_t udiv_step(uint16_t* hi, uint16_t lo, uint16_t den)
+{
+    uint16_t r = *hi;
+
+    for(uint8_t i = 0; i < 16; i++)
+    {
+        // The bit shifted out of r is the 17th bit of the partial remainder
+        bool carry = r & 0x8000;
+
+        r = (r << 1) | (lo >> 15);
+        lo <<= 1;
+
+        if(carry || r >= den)
+        {
+            r -= den;
+            lo |= 1;
+        }
+    }
+
+    *hi = r;
+    return lo;
+}
+
+/**
+ * @brief Divides a 32-bit value by a 16-bit value.
+ *
+ * @param num The dividend.
+ * @param den The divisor. Division by zero returns 0xFFFFFFFF.
+ * @param rem If not null, receives the remainder.
+ *
+ * @return The quotient.
+ */
+uint32_t udiv32_16(uint32_t num, uint16_t den, uint16_t* rem)
+{
+    uint16_t r = 0;
+    uint32_t q;
+
+    if(!den)
+    {
+        if(rem)
+            *rem = 0;
+        return UINT32_MAX;
+    }
+
+    q = (uint32_t)udiv_step(&r, num >> 16, den) << 16;
+    q |= udiv_step(&r, num, den);
+
+    if(rem)
+        *rem = r;
+    return q;
+}
+
+/**
+ * @brief Computes (num << shift) / den without overflowing the intermediate.
+ *
+ * @param num The dividend.
+ * @param den The divisor.
+ * @param shift The number of fractional bits in the result, at most 16.
+ *
+ * @return The quotient, saturated to 0xFFFFFFFF.
+ */
+uint32_t udiv_shift(uint32_t num, uint16_t den, uint8_t shift)
+{
+    uint16_t r;
+    uint32_t q = udiv32_16(num, den, &r);
+
+    if(!shift)
+        return q;
+
+    if(q >> (32 - shift))
+        return UINT32_MAX;
+
+    // floor(floor(r * 2^16 / den) / 2^(16 - shift)) == floor(r * 2^shift / den)
+    return (q << shift) | (udiv_step(&r, 0, den) >> (16 - shift));
+}
+
+/**
+ * @brief Divides an integer by an unsigned integer, giving a 16.16 result.
+ *
+ * @param num The dividend.
+ * @param den The divisor.
+ *
+ * @return num / den, rounded towards zero and saturated.
+ */
+q16_t q16_div(int32_t num, uint16_t den)
+{
+    uint32_t q = udiv_shift((num < 0) ? -(uint32_t)num : (uint32_t)num, den, 16);
+
+    if(q > INT32_MAX)
+        q = INT32_MAX;
+
+    return (num < 0) ? -(q16_t)q : (q16_t)q;
+}
+
+/**
+ * @brief Computes a reciprocal.
+ *
+ * @param den The value to invert.
+ *
+ * @return 1 / den as a fraction, saturated to 0xFFFF for den <= 1.
+ */
+uq16_t recip_u16(uint16_t den)
+{
+    uint16_t r = 1;
+
+    if(den <= 1)
+        return UINT16_MAX;
+
+    // 0x10000 / den, with the leading 1 as the initial remainder
+    return udiv_step(&r, 0, den);
+}
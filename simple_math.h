@@ -29,9 +29,136 @@
 #ifndef SIMPLE_MATH_H_
 #define SIMPLE_MATH_H_
 
-#define lesser(a, b) (((a)<(b))?(a):(b))
-#define greater(a, b) (((a)>(b))?(a):(b))
-#define distance(a, b) (((a)>(b))?((a)-(b)):((b)-(a)))
-#define clip(a, b, t) (((t)<(a))?(a):((((t)>(b))?(b):(t))))
+#include <stdint.h>
+
+/*
+ * Fixed-point types. The suffix gives the number of fractional bits:
+ * q15_t  signed, [-1, 1)
+ * uq16_t unsigned, [0, 1)
+ * q16_t  signed 16.16
+ */
+typedef int16_t q15_t;
+typedef uint16_t uq16_t;
+typedef int32_t q16_t;
+
+#define Q15(x) ((q15_t)((x) * 32768.0))
+#define UQ16(x) ((uq16_t)((x) * 65536.0))
+#define Q16(x) ((q16_t)((x) * 65536.0))
+
+#define Q15_MAX INT16_MAX
+#define Q15_MIN INT16_MIN
+
+/*
+ * Comparison helpers. These used to be macros; as functions each argument is
+ * evaluated exactly once. The arguments are converted to uint16_t without a
+ * warning, even under -Wall -Wextra, so a negative value compares as a large
+ * one: use the _s16 versions for signed values.
+ */
+static inline uint16_t lesser(uint16_t a, uint16_t b)
+{
+    return (a < b) ? a : b;
+}
+
+static inline uint16_t greater(uint16_t a, uint16_t b)
+{
+    return (a > b) ? a : b;
+}
+
+static inline int16_t lesser_s16(int16_t a, int16_t b)
+{
+    return (a < b) ? a : b;
+}
+
+static inline int16_t greater_s16(int16_t a, int16_t b)
+{
+    return (a > b) ? a : b;
+}
+
+static inline uint16_t distance(uint16_t a, uint16_t b)
+{
+    return (a > b) ? (a - b) : (b - a);
+}
+
+static inline uint16_t clip(uint16_t a, uint16_t b, uint16_t t)
+{
+    return (t < a) ? a : ((t > b) ? b : t);
+}
+
+/* Saturating arithmetic */
+static inline uint16_t sat_add_u16(uint16_t a, uint16_t b)
+{
+    uint16_t r = a + b;
+    return (r < a) ? UINT16_MAX : r;
+}
+
+static inline uint16_t sat_sub_u16(uint16_t a, uint16_t b)
+{
+    return (a > b) ? (a - b) : 0;
+}
+
+static inline uint16_t sat_mul_u16(uint16_t a, uint16_t b)
+{
+    uint32_t r = (uint32_t)a * b;
+    return (r > UINT16_MAX) ? UINT16_MAX : (uint16_t)r;
+}
+
+/* Applies a signed offset to an unsigned value, saturating at 0 and 0xFFFF. */
+static inline uint16_t sat_offset_u16(uint16_t a, int16_t d)
+{
+    return (d < 0) ? sat_sub_u16(a, -(int32_t)d) : sat_add_u16(a, d);
+}
+
+static inline int16_t sat_add_s16(int16_t a, int16_t b)
+{
+    int32_t r = (int32_t)a + b;
+    return (r > INT16_MAX) ? INT16_MAX : ((r < INT16_MIN) ? INT16_MIN : r);
+}
+
+static inline int16_t sat_sub_s16(int16_t a, int16_t b)
+{
+    int32_t r = (int32_t)a - b;
+    return (r > INT16_MAX) ? INT16_MAX : ((r < INT16_MIN) ? INT16_MIN : r);
+}
+
+#define q15_add(a, b) sat_add_s16((a), (b))
+#define q15_sub(a, b) sat_sub_s16((a), (b))
+
+static inline q15_t q15_mul(q15_t a, q15_t b)
+{
+    int32_t r = (int32_t)a * b;
+
+    // -1 * -1 is the only product that does not fit
+    if(r == 0x40000000l)
+        return Q15_MAX;
+
+    return r >> 15;
+}
+
+/**
+ * @brief Linearly interpolates between two unsigned values.
+ *
+ * @param a The value at t = 0.
+ * @param b The value at t = 1.
+ * @param t The interpolation parameter.
+ *
+ * @return a + (b - a) * t, rounded towards a.
+ */
+static inline uint16_t lerp_u16(uint16_t a, uint16_t b, uq16_t t)
+{
+    if(b >= a)
+        return a + (((uint32_t)(b - a) * t) >> 16);
+
+    return a - (((uint32_t)(a - b) * t) >> 16);
+}
+
+/*
+ * Division. The MSP430 has no divider (and the smaller parts no multiplier);
+ * these are built from 16-bit shift-and-subtract steps, which is cheaper than
+ * libgcc's generic 32-bit division.
+ */
+uint32_t udiv32_16(uint32_t num, uint16_t den, uint16_t* rem);
+uint32_t udiv_shift(uint32_t num, uint16_t den, uint8_t shift);
+q16_t q16_div(int32_t num, uint16_t den);
+uq16_t recip_u16(uint16_t den);
 
 #endif /* SIMPLE_MATH_H_ */